@@ -0,0 +1,121 @@
+#include "audio.h"
+
+#ifndef DSU_ONLY
+
+#include <coreinit/mutex.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <stddef.h>
+
+#include "microphone.h"
+#include "rwug.h"
+#include "telemetry.h"
+#include "udp_socket.h"
+
+// Duration of an audio frame, in microseconds. Every frame is sent in its own packet.
+#define AUDIO_FRAME_DURATION 5000
+#define AUDIO_FRAME_SAMPLES (MICROPHONE_SAMPLE_RATE / (1000000 / AUDIO_FRAME_DURATION))
+
+// Stack size of the audio thread, in bytes.
+#define AUDIO_STACK_SIZE 0x8000
+
+// Priority of the audio thread. It runs after the main and sampling threads, so audio never delays controller samples.
+#define AUDIO_THREAD_PRIORITY 17
+
+static OSThread thread __attribute__((aligned(8)));
+static uint8_t stack[AUDIO_STACK_SIZE] __attribute__((aligned(16)));
+static volatile bool running = false;
+
+// Audio has its own socket, so sending it doesn't need to be synchronized with the input packets.
+static int audio_socket = -1;
+
+// The main loop changes the server address and the handshake changes the features while holding the mutex,
+// so both are copied under it.
+static const struct sockaddr_in* audio_server_address;
+static OSMutex* server_mutex;
+
+static int16_t frame[AUDIO_FRAME_SAMPLES];
+static uint8_t outgoing_packet[RWUG_MAX_AUDIO_SIZE];
+static uint32_t outgoing_sequence = 0;
+
+// Same time base as the timestamps of the input packets.
+static uint64_t get_time() {
+    return OSTicksToMicroseconds(OSGetSystemTime());
+}
+
+static void send_frames() {
+    OSLockMutex(server_mutex);
+    const struct sockaddr_in server_address = *audio_server_address;
+    const bool audio_enabled = get_rwug_features() & RWUG_FEATURE_AUDIO;
+    OSUnlockMutex(server_mutex);
+
+    uint32_t age;
+    while (read_microphone(frame, AUDIO_FRAME_SAMPLES, &age)) {
+        // Frames are captured and numbered even if the server didn't agree to receive them, so the sequence starts
+        // with a gap instead of stale audio after a handshake.
+        uint32_t sequence = outgoing_sequence++;
+        if (!audio_enabled) continue;
+
+        uint16_t packet_size = pack_audio_packet(outgoing_packet, sequence, get_time() - age, MICROPHONE_SAMPLE_RATE, frame, AUDIO_FRAME_SAMPLES);
+
+        // Bypasses the network impairment emulation, which is only safe to use from one thread, so audio is never impaired.
+        if (sendto(audio_socket, outgoing_packet, packet_size, 0, (const struct sockaddr*) &server_address, sizeof(server_address)) >= 0) {
+            ++telemetry.audio_packets_sent;
+        }
+    }
+}
+
+static int audio_thread(int argc, const char** argv) {
+    OSTime next_frame = OSGetSystemTime();
+
+    while (running) {
+        next_frame += OSMicrosecondsToTicks(AUDIO_FRAME_DURATION);
+
+        OSTime now = OSGetSystemTime();
+        if (next_frame > now) OSSleepTicks(next_frame - now);
+        else next_frame = now;
+
+        send_frames();
+    }
+
+    return 0;
+}
+
+// Streams the microphone to the RWUG server on a separate thread, as long as the server agreed to receive audio.
+// mutex guards the server address and the RWUG handshake.
+bool start_audio(const struct sockaddr_in* server_address, OSMutex* mutex) {
+    audio_server_address = server_address;
+    server_mutex = mutex;
+
+    audio_socket = init_udp_socket(0);
+    if (audio_socket < 0) return false;
+
+    if (!open_microphone()) {
+        destroy_udp_socket(&audio_socket);
+        return false;
+    }
+
+    running = true;
+    if (!OSCreateThread(&thread, audio_thread, 0, NULL, stack + AUDIO_STACK_SIZE, AUDIO_STACK_SIZE, AUDIO_THREAD_PRIORITY, OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+        running = false;
+        close_microphone();
+        destroy_udp_socket(&audio_socket);
+        return false;
+    }
+
+    OSSetThreadName(&thread, "RWUG audio");
+    OSResumeThread(&thread);
+    return true;
+}
+
+void stop_audio() {
+    if (!running) return;
+
+    running = false;
+    OSJoinThread(&thread, NULL);
+
+    close_microphone();
+    destroy_udp_socket(&audio_socket);
+}
+
+#endif
@@ -0,0 +1,6 @@
+#include <coreinit/mutex.h>
+#include <arpa/inet.h>
+#include <stdbool.h>
+
+bool start_audio(const struct sockaddr_in* server_address, OSMutex* mutex);
+void stop_audio();
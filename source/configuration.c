@@ -3,16 +3,110 @@
 #include <whb/sdcard.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <ini.h>
 
+#include "prediction.h"
+
 static int handler(void* out, const char* section, const char* name, const char* value) {
     configuration* config = (configuration*) out;
 
     if (strcmp(section, "general") == 0) {
         if (strcmp(name, "ip_address") == 0) {
-            config->ip_address = strdup(value);
+            snprintf(config->ip_address, sizeof(config->ip_address), "%s", value);
         } else if (strcmp(name, "mode") == 0) {
             config->mode = atoi(value);
+        } else if (strcmp(name, "auto_start") == 0) {
+            config->auto_start = atoi(value) != 0;
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "rwug") == 0) {
+        if (strcmp(name, "history_length") == 0) {
+            config->history_length = atoi(value);
+        } else if (strcmp(name, "edges") == 0) {
+            config->edges = atoi(value) != 0;
+        } else if (strcmp(name, "microphone") == 0) {
+            config->microphone = atoi(value) != 0;
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "prediction") == 0) {
+        if (strcmp(name, "latency") == 0) {
+            config->prediction_latency = strcmp(value, "auto") == 0 ? PREDICTION_LATENCY_MEASURED : strtoul(value, NULL, 10);
+        } else if (strcmp(name, "alpha") == 0) {
+            config->prediction_alpha = strtof(value, NULL);
+        } else if (strcmp(name, "beta") == 0) {
+            config->prediction_beta = strtof(value, NULL);
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "power") == 0) {
+        if (strcmp(name, "idle_timeout") == 0) {
+            config->idle_timeout = strtoul(value, NULL, 10);
+        } else if (strcmp(name, "screen_timeout") == 0) {
+            config->screen_timeout = strtoul(value, NULL, 10);
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "timing") == 0) {
+        if (strcmp(name, "sampling_callback") == 0) {
+            config->sampling_callback = atoi(value) != 0;
+        } else if (strcmp(name, "send_interval") == 0) {
+            config->send_interval = strtoul(value, NULL, 10);
+        } else if (strcmp(name, "average_motion") == 0) {
+            config->average_motion = atoi(value) != 0;
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "remap") == 0) {
+        return set_button_remap(&config->remap, name, value);
+    } else if (strcmp(section, "sticks") == 0) {
+        if (strcmp(name, "deadzone") == 0) {
+            config->remap.stick_deadzone = strtof(value, NULL);
+        } else if (strcmp(name, "exponent") == 0) {
+            config->remap.stick_exponent = strtof(value, NULL);
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "impairment") == 0) {
+        if (strcmp(name, "loss") == 0) {
+            config->impairment.loss = strtof(value, NULL);
+        } else if (strcmp(name, "duplication") == 0) {
+            config->impairment.duplication = strtof(value, NULL);
+        } else if (strcmp(name, "reordering") == 0) {
+            config->impairment.reordering = strtof(value, NULL);
+        } else if (strcmp(name, "delay") == 0) {
+            config->impairment.delay = strtoul(value, NULL, 10);
+        } else if (strcmp(name, "jitter") == 0) {
+            config->impairment.jitter = strtoul(value, NULL, 10);
+        } else if (strcmp(name, "seed") == 0) {
+            config->impairment.seed = strtoul(value, NULL, 10);
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "dsu") == 0) {
+        if (strcmp(name, "ports") == 0) {
+            // A comma separated list, e.g. "26760, 26761".
+            char* end;
+            config->dsu_port_count = 0;
+            for (uint16_t port = strtoul(value, &end, 10); end != value && config->dsu_port_count < DSU_MAX_SERVERS; port = strtoul(value, &end, 10)) {
+                config->dsu_ports[config->dsu_port_count++] = port;
+                value = end + strspn(end, ", ");
+            }
+
+            if (config->dsu_port_count == 0) {
+                config->dsu_ports[0] = DSU_DEFAULT_PORT;
+                config->dsu_port_count = 1;
+            }
+        } else {
+            return 0;
+        }
+    } else if (strcmp(section, "telemetry") == 0) {
+        if (strcmp(name, "address") == 0) {
+            snprintf(config->telemetry_address, sizeof(config->telemetry_address), "%s", value);
+        } else if (strcmp(name, "port") == 0) {
+            config->telemetry_port = atoi(value);
         } else {
             return 0;
         }
@@ -28,16 +122,78 @@ void get_configuration_path(char* path) {
 }
 
 configuration load_configuration(const char* path) {
-    configuration config = { "192.168.0.1", 0 };
-    ini_parse(path, handler, &config);
+    // Fields that aren't listed default to 0.
+    configuration config = {
+        .ip_address = "192.168.0.1",
+        .auto_start = true,
+        .prediction_alpha = 0.5f,
+        .prediction_beta = 0.1f,
+        .idle_timeout = 30,
+        .screen_timeout = 60,
+        .send_interval = 10000,
+        .average_motion = true,
+        .dsu_ports = { DSU_DEFAULT_PORT },
+        .dsu_port_count = 1,
+        .telemetry_port = 4244,
+        .impairment = { .seed = 1 }
+    };
+    reset_remap_settings(&config.remap);
+    config.loaded = ini_parse(path, handler, &config) >= 0;
 
     return config;
 }
 
-void save_configuration(const char* path, const char* ip_address, const uint8_t mode) {
+static void write_general_section(FILE* file, const configuration* config) {
+    fprintf(file, "[general]\nip_address=%s\nmode=%d\nauto_start=%d\n\n", config->ip_address, config->mode, config->auto_start);
+}
+
+// Reads the whole file. Returns NULL if it couldn't be read completely, an empty string if it doesn't exist.
+static char* read_configuration_file(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) return calloc(1, 1);
+
+    char* contents = NULL;
+    long size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+
+    if (size >= 0 && fseek(file, 0, SEEK_SET) == 0 && (contents = malloc(size + 1)) != NULL) {
+        if (fread(contents, 1, size, file) == (size_t) size) {
+            contents[size] = '\0';
+        } else {
+            free(contents);
+            contents = NULL;
+        }
+    }
+
+    fclose(file);
+    return contents;
+}
+
+// Rewrites the [general] section and keeps every other section of the existing file untouched.
+// Nothing is written if the existing file can't be read completely, so no section is lost.
+void save_configuration(const char* path, const configuration* config) {
+    char* previous = read_configuration_file(path);
+    if (previous == NULL) return;
+
     FILE* file = fopen(path, "w");
-    if (file != NULL) {
-        fprintf(file, "[general]\nip_address=%s\nmode=%d\n\n", ip_address, mode);
-        fclose(file);
+    if (file == NULL) {
+        free(previous);
+        return;
     }
-}
\ No newline at end of file
+
+    write_general_section(file, config);
+
+    bool in_general = false;
+    char* line = previous;
+    while (*line != '\0') {
+        char* line_end = strchr(line, '\n');
+        size_t line_length = line_end != NULL ? (size_t) (line_end - line) + 1 : strlen(line);
+
+        if (line[0] == '[') in_general = strncmp(line, "[general]", 9) == 0;
+        if (!in_general) fwrite(line, 1, line_length, file);
+
+        line += line_length;
+    }
+
+    fclose(file);
+    free(previous);
+}
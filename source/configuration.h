@@ -1,10 +1,63 @@
 #include <stdint.h>
+#include <stdbool.h>
+
+#include "remap.h"
+#include "impairment.h"
+#include "dsu.h"
+
+// Size of the IPv4 address strings, including the terminator.
+#define CONFIGURATION_ADDRESS_SIZE 16
 
 typedef struct {
-    const char* ip_address;
+    char ip_address[CONFIGURATION_ADDRESS_SIZE];
     uint8_t mode;
+    bool auto_start;
+
+    // Amount of previous inputs that are repeated in every RWUG packet. 0 sends the legacy packet without extensions.
+    uint8_t history_length;
+
+    // Whether RWUG packets report button presses and releases that happened between two packets.
+    bool edges;
+
+    // Whether the microphone is streamed to RWUG servers that support it.
+    bool microphone;
+
+    // Time the RWUG packets' motion and stick data is extrapolated into the future, in microseconds. 0 disables prediction.
+    uint32_t prediction_latency;
+    float prediction_alpha;
+    float prediction_beta;
+
+    // Time without input and listeners until the update rate drops, and time without input until the GamePad screen turns off,
+    // in seconds. 0 disables either.
+    uint32_t idle_timeout;
+    uint32_t screen_timeout;
+
+    // Whether samples are sent when VPAD receives them instead of on a fixed timer.
+    bool sampling_callback;
+
+    // Interval between two sent samples, in microseconds. Motion is averaged over the samples of an interval
+    // instead of sending only the newest one if average_motion is set.
+    uint32_t send_interval;
+    bool average_motion;
+
+    // Ports of the DSU servers. The first one also sends and receives the RWUG packets.
+    uint16_t dsu_ports[DSU_MAX_SERVERS];
+    uint8_t dsu_port_count;
+
+    // Telemetry is only published if a collector address is set.
+    char telemetry_address[CONFIGURATION_ADDRESS_SIZE];
+    uint16_t telemetry_port;
+
+    // Button remapping and stick response, applied to every sample before it's sent.
+    remap_settings remap;
+
+    // Emulated network impairments. Only used if built with NETWORK_IMPAIRMENT.
+    impairment_settings impairment;
+
+    // Whether the configuration file exists and could be parsed.
+    bool loaded;
 } configuration;
 
 void get_configuration_path(char* path);
 configuration load_configuration(const char* path);
-void save_configuration(const char* path, const char* ip_address, const uint8_t mode);
\ No newline at end of file
+void save_configuration(const char* path, const configuration* config);
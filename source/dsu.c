@@ -1,10 +1,16 @@
 #include "dsu.h"
 
+#ifndef RWUG_ONLY
+
 #include <arpa/inet.h>
 #include <string.h>
 #include <zlib.h>
 
 #include "byte_swap.h"
+#include "sample_conversion.h"
+#include "flight_recorder.h"
+#include "remap.h"
+#include "udp_socket.h"
 
 // This DSU implementation doesn't fully follow the specifications for the sake of efficiency.
 // If this causes any issues with DSU clients, we should send information about all requested controllers
@@ -14,17 +20,58 @@
 // If this time is exceeded, no more data will be sent unless new data requests are received.
 #define DATA_REQUEST_TIMEOUT 30000000
 
-// Length of the incoming and outgoing packets, in bytes. Currently set to the absolute minimum.
-#define INCOMING_BUFFER_SIZE 28
-#define OUTGOING_BUFFER_SIZE 100
-
 #define PROTOCOL_VERSION 1001
 
 #define PACKET_TYPE_PROTOCOL_INFORMATION 0x100000
 #define PACKET_TYPE_CONTROLLER_INFORMATION 0x100001
 #define PACKET_TYPE_CONTROLLER_DATA 0x100002
 
-void set_packet_header(uint8_t* packet, uint8_t packet_length) {
+// Bits of the DSU button bytes, the first byte in the lower 8 bits.
+static const uint32_t dsu_buttons[][2] = {
+    { VPAD_BUTTON_MINUS,   1 << 0  },
+    { VPAD_BUTTON_STICK_L, 1 << 1  },
+    { VPAD_BUTTON_STICK_R, 1 << 2  },
+    { VPAD_BUTTON_PLUS,    1 << 3  },
+    { VPAD_BUTTON_UP,      1 << 4  },
+    { VPAD_BUTTON_RIGHT,   1 << 5  },
+    { VPAD_BUTTON_DOWN,    1 << 6  },
+    { VPAD_BUTTON_LEFT,    1 << 7  },
+    { VPAD_BUTTON_ZL,      1 << 8  },
+    { VPAD_BUTTON_ZR,      1 << 9  },
+    { VPAD_BUTTON_L,       1 << 10 },
+    { VPAD_BUTTON_R,       1 << 11 },
+    { VPAD_BUTTON_X,       1 << 12 },
+    { VPAD_BUTTON_A,       1 << 13 },
+    { VPAD_BUTTON_B,       1 << 14 },
+    { VPAD_BUTTON_Y,       1 << 15 }
+};
+
+// VPAD button bitfield to DSU button bytes.
+static button_table button_layout;
+
+// Analog button bytes of 4 button bits, highest bit first.
+static uint8_t analog_buttons[16][4];
+
+void init_dsu() {
+    uint32_t buttons[REMAP_BUTTONS] = { 0 };
+    for (uint8_t i = 0; i < sizeof(dsu_buttons) / sizeof(dsu_buttons[0]); ++i) {
+        buttons[__builtin_ctz(dsu_buttons[i][0])] = dsu_buttons[i][1];
+    }
+    build_button_table(&button_layout, buttons);
+
+    for (uint8_t bits = 0; bits < 16; ++bits) {
+        for (uint8_t i = 0; i < 4; ++i) {
+            analog_buttons[bits][i] = (bits >> (3 - i)) & 1 ? 255 : 0;
+        }
+    }
+}
+
+// Stick values are already limited to [-1, 1] by the remapping.
+static uint8_t stick_to_byte(const float value) {
+    return (uint8_t) (value * 127.5f + 127.5f);
+}
+
+void set_packet_header(uint8_t* packet, uint8_t packet_length, const uint32_t server_id) {
     // Magic string — DSUS if it’s message by server (you), DSUC if by client (cemuhook).
     packet[0]  = (uint8_t) 'D';
     packet[1]  = (uint8_t) 'S';
@@ -46,16 +93,16 @@ void set_packet_header(uint8_t* packet, uint8_t packet_length) {
     packet[11] = 0x00;
 
     // Server ID
-    packet[12] = 0x01;
-    packet[13] = 0x02;
-    packet[14] = 0x03;
-    packet[15] = 0x04;
+    packet[12] = (server_id >> 24) & 0xFF;
+    packet[13] = (server_id >> 16) & 0xFF;
+    packet[14] = (server_id >> 8 ) & 0xFF;
+    packet[15] = (server_id      ) & 0xFF;
 
     uint32_t checksum = bswap32u(crc32(0L, (const void*) packet, packet_length));
     memcpy(&packet[8], &checksum, sizeof(checksum));
 }
 
-uint8_t pack_protocol_information(uint8_t* packet) {
+uint8_t pack_protocol_information(uint8_t* packet, const uint32_t server_id) {
     packet[16] = (PACKET_TYPE_PROTOCOL_INFORMATION      ) & 0xFF;
     packet[17] = (PACKET_TYPE_PROTOCOL_INFORMATION >> 8 ) & 0xFF;
     packet[18] = (PACKET_TYPE_PROTOCOL_INFORMATION >> 16) & 0xFF;
@@ -64,11 +111,11 @@ uint8_t pack_protocol_information(uint8_t* packet) {
     packet[20] = (PROTOCOL_VERSION     ) & 0xFF;
     packet[21] = (PROTOCOL_VERSION >> 8) & 0xFF;
 
-    set_packet_header(packet, 22);
+    set_packet_header(packet, 22, server_id);
     return 22;
 }
 
-uint8_t pack_controller_information(uint8_t* packet) {
+uint8_t pack_controller_information(uint8_t* packet, const uint32_t server_id) {
     packet[16] = (PACKET_TYPE_CONTROLLER_INFORMATION      ) & 0xFF;
     packet[17] = (PACKET_TYPE_CONTROLLER_INFORMATION >> 8 ) & 0xFF;
     packet[18] = (PACKET_TYPE_CONTROLLER_INFORMATION >> 16) & 0xFF;
@@ -93,11 +140,11 @@ uint8_t pack_controller_information(uint8_t* packet) {
     // Termination byte.
     packet[31] = 0x00;
 
-    set_packet_header(packet, 32);
+    set_packet_header(packet, 32, server_id);
     return 32;
 }
 
-uint8_t pack_controller_data(uint8_t* packet, uint32_t packet_count, uint64_t timestamp, float accelerometerX, float accelerometerY, float accelerometerZ, float gyroscopePitch, float gyroscopeYaw, float gyroscopeRoll, uint8_t touchpadActive, uint16_t touchpadX, uint16_t touchpadY, VPADStatus* pad) {
+uint8_t pack_controller_data(uint8_t* packet, const uint32_t server_id, uint32_t packet_count, uint64_t timestamp, const uint32_t* motion, uint8_t touchpadActive, uint16_t touchpadX, uint16_t touchpadY, uint32_t hold, VPADStatus* pad) {
     packet[16] = (PACKET_TYPE_CONTROLLER_DATA      ) & 0xFF;
     packet[17] = (PACKET_TYPE_CONTROLLER_DATA >> 8 ) & 0xFF;
     packet[18] = (PACKET_TYPE_CONTROLLER_DATA >> 16) & 0xFF;
@@ -125,58 +172,23 @@ uint8_t pack_controller_data(uint8_t* packet, uint32_t packet_count, uint64_t ti
     // Packet number (for this client).
     memcpy(&packet[32], &packet_count, sizeof(packet_count));
 
-    uint8_t button_left  = (pad->hold & VPAD_BUTTON_LEFT)  != 0;
-    uint8_t button_down  = (pad->hold & VPAD_BUTTON_DOWN)  != 0;
-    uint8_t button_right = (pad->hold & VPAD_BUTTON_RIGHT) != 0;
-    uint8_t button_up    = (pad->hold & VPAD_BUTTON_UP)    != 0;
-    uint8_t button_y     = (pad->hold & VPAD_BUTTON_Y)     != 0;
-    uint8_t button_b     = (pad->hold & VPAD_BUTTON_B)     != 0;
-    uint8_t button_a     = (pad->hold & VPAD_BUTTON_A)     != 0;
-    uint8_t button_x     = (pad->hold & VPAD_BUTTON_X)     != 0;
-    uint8_t button_r     = (pad->hold & VPAD_BUTTON_R)     != 0;
-    uint8_t button_l     = (pad->hold & VPAD_BUTTON_L)     != 0;
-    uint8_t button_zr    = (pad->hold & VPAD_BUTTON_ZR)    != 0;
-    uint8_t button_zl    = (pad->hold & VPAD_BUTTON_ZL)    != 0;
-
-    packet[36] = button_left  << 7 |
-                 button_down  << 6 |
-                 button_right << 5 |
-                 button_up    << 4 |
-                 ((uint8_t) ((pad->hold & VPAD_BUTTON_PLUS)    != 0)) << 3 |
-                 ((uint8_t) ((pad->hold & VPAD_BUTTON_STICK_R) != 0)) << 2 |
-                 ((uint8_t) ((pad->hold & VPAD_BUTTON_STICK_L) != 0)) << 1 |
-                 ((uint8_t) ((pad->hold & VPAD_BUTTON_MINUS)   != 0));
-
-    packet[37] = button_y  << 7 |
-                 button_b  << 6 |
-                 button_a  << 5 |
-                 button_x  << 4 |
-                 button_r  << 3 |
-                 button_l  << 2 |
-                 button_zr << 1 |
-                 button_zl;
+    uint16_t buttons = (uint16_t) lookup_button_table(&button_layout, hold);
+    packet[36] = buttons & 0xFF;
+    packet[37] = buttons >> 8;
 
     packet[38] = 0x00; // PS Button (unused)
     packet[39] = 0x00; // Touch Button (unused)
 
     // The neutral value is 127.
-    packet[40] = (uint8_t) (pad->leftStick.x  * 128 + 127); // Left stick X (plus rightward)
-    packet[41] = (uint8_t) (pad->leftStick.y  * 128 + 127); // Left stick Y (plus upward)
-    packet[42] = (uint8_t) (pad->rightStick.x * 128 + 127); // Right stick X (plus rightward)
-    packet[43] = (uint8_t) (pad->rightStick.y * 128 + 127); // Right stick Y (plus upward)
-
-    packet[44] = button_left  * 255; // Analog D-Pad Left
-    packet[45] = button_down  * 255; // Analog D-Pad Down
-    packet[46] = button_right * 255; // Analog D-Pad Right
-    packet[47] = button_up    * 255; // Analog D-Pad Up
-    packet[48] = button_y     * 255; // Analog Y
-    packet[49] = button_b     * 255; // Analog B
-    packet[50] = button_a     * 255; // Analog A
-    packet[51] = button_x     * 255; // Analog X
-    packet[52] = button_r     * 255; // Analog R1
-    packet[53] = button_l     * 255; // Analog L1
-    packet[54] = button_zr    * 255; // Analog R2
-    packet[55] = button_zl    * 255; // Analog L2
+    packet[40] = stick_to_byte(pad->leftStick.x);  // Left stick X (plus rightward)
+    packet[41] = stick_to_byte(pad->leftStick.y);  // Left stick Y (plus upward)
+    packet[42] = stick_to_byte(pad->rightStick.x); // Right stick X (plus rightward)
+    packet[43] = stick_to_byte(pad->rightStick.y); // Right stick Y (plus upward)
+
+    // Analog D-Pad Left, Down, Right, Up, Y, B, A, X, R1, L1, R2 and L2, in the order of the button bits.
+    memcpy(&packet[44], analog_buttons[packet[36] >> 4],   4);
+    memcpy(&packet[48], analog_buttons[packet[37] >> 4],   4);
+    memcpy(&packet[52], analog_buttons[packet[37] & 0x0F], 4);
 
     // First touch.
     packet[56] = touchpadActive; // Active
@@ -195,77 +207,115 @@ uint8_t pack_controller_data(uint8_t* packet, uint32_t packet_count, uint64_t ti
     // Motion data timestamp in microseconds (8 bytes).
     memcpy(&packet[68], &timestamp, sizeof(timestamp));
 
-    // Accelerometer data (4 bytes each).
-    memcpy(&packet[76], &accelerometerX, sizeof(accelerometerX));
-    memcpy(&packet[80], &accelerometerY, sizeof(accelerometerY));
-    memcpy(&packet[84], &accelerometerZ, sizeof(accelerometerZ));
-
-    // Gyroscope data (4 bytes each).
-    memcpy(&packet[88], &gyroscopePitch, sizeof(gyroscopePitch));
-    memcpy(&packet[92], &gyroscopeYaw, sizeof(gyroscopeYaw));
-    memcpy(&packet[96], &gyroscopeRoll, sizeof(gyroscopeRoll));
+    // Accelerometer and gyroscope data (4 bytes each), already converted in the same order.
+    memcpy(&packet[76], motion, 6 * sizeof(uint32_t));
 
-    set_packet_header(packet, 100);
+    set_packet_header(packet, 100, server_id);
     return 100;
 }
 
-uint64_t last_data_requested = 0;
-uint32_t outgoing_packet_count = 0;
+// Uses the given socket, or opens its own on the port if it's < 0.
+bool init_dsu_server(dsu_server* server, const int socket, const uint16_t port, const uint32_t server_id) {
+    memset(server, 0, sizeof(*server));
 
-uint8_t outgoing_packet[OUTGOING_BUFFER_SIZE];
-uint8_t incoming_packet[INCOMING_BUFFER_SIZE];
+    server->port = port;
+    server->server_id = server_id;
+    server->owns_socket = socket < 0;
+    server->socket = server->owns_socket ? init_udp_socket(port) : socket;
+    server->subscriber_size = sizeof(server->subscriber);
 
-struct sockaddr_in sender;
-socklen_t sender_size = sizeof(sender);
+    return server->socket >= 0;
+}
 
-void update_dsu(int* socket, uint64_t* timestamp, VPADStatus* pad, VPADTouchData* touchpad) {
-    // This operation is non-blocking due to MSG_DONTWAIT.
-    // request_length is < 0 if recvfrom() would block.
-    ssize_t request_length = recvfrom(*socket, incoming_packet, INCOMING_BUFFER_SIZE, MSG_DONTWAIT, (struct sockaddr*) &sender, &sender_size);
+void destroy_dsu_server(dsu_server* server) {
+    if (server->owns_socket) destroy_udp_socket(&server->socket);
+}
 
+bool handle_dsu_request(dsu_server* server, const uint8_t* incoming_packet, ssize_t request_length, const struct sockaddr_in* request_sender, uint64_t* timestamp) {
     // Must be longer than header (> 16) and sent by client (DSUC).
-    if (request_length > 16 && strncmp((const char*) incoming_packet, "DSUC", 4) == 0) {
-        switch (incoming_packet[16]) {
-            // Protocol Information Request
-            case 0x00: {
-                uint8_t packet_size = pack_protocol_information(outgoing_packet);
-                sendto(*socket, outgoing_packet, packet_size, 0, (const struct sockaddr*) &sender, sender_size);
-                break;
-            }
-
-            // Controller Information Request
-            case 0x01: {
-                uint8_t packet_size = pack_controller_information(outgoing_packet);
-                sendto(*socket, outgoing_packet, packet_size, 0, (const struct sockaddr*) &sender, sender_size);
-                break;
-            }
-
-            // Controller Data Request
-            case 0x02: {
-                last_data_requested = *timestamp;
-                break;
-            }
+    if (request_length <= 16 || strncmp((const char*) incoming_packet, "DSUC", 4) != 0) return false;
+
+    server->subscriber = *request_sender;
+    ++server->statistics.requests;
+    record_flight_event(FLIGHT_EVENT_DSU_REQUEST, ntohl(server->subscriber.sin_addr.s_addr), incoming_packet[16]);
+
+    const struct sockaddr* subscriber = (const struct sockaddr*) &server->subscriber;
+
+    switch (incoming_packet[16]) {
+        // Protocol Information Request
+        case 0x00: {
+            uint8_t packet_size = pack_protocol_information(server->outgoing_packet, server->server_id);
+            send_udp_socket(server->socket, server->outgoing_packet, packet_size, subscriber, server->subscriber_size);
+            break;
+        }
+
+        // Controller Information Request
+        case 0x01: {
+            uint8_t packet_size = pack_controller_information(server->outgoing_packet, server->server_id);
+            send_udp_socket(server->socket, server->outgoing_packet, packet_size, subscriber, server->subscriber_size);
+            break;
+        }
+
+        // Controller Data Request
+        case 0x02: {
+            server->data_requested = true;
+            server->last_data_requested = *timestamp;
+            break;
         }
     }
 
-    if (*timestamp - last_data_requested < DATA_REQUEST_TIMEOUT) {
-        float accelerometerX = bswap32f(-pad->accelorometer.acc.x);
-        float accelerometerY = bswap32f( pad->accelorometer.acc.y);
-        float accelerometerZ = bswap32f(-pad->accelorometer.acc.z);
+    return true;
+}
+
+// Answers the requests on a server's own socket. Returns the amount of requests.
+uint8_t receive_dsu_requests(dsu_server* server, uint64_t* timestamp) {
+    if (!server->owns_socket) return 0;
 
-        float gyroscopePitch = bswap32f(-pad->gyro.x * 360.0);
-        float gyroscopeYaw   = bswap32f(-pad->gyro.y * 360.0);
-        float gyroscopeRoll  = bswap32f( pad->gyro.z * 360.0);
+    uint8_t incoming_packet[DSU_INCOMING_BUFFER_SIZE];
+    struct sockaddr_in sender;
+    uint8_t requests = 0;
+
+    for (uint8_t i = 0; i < DSU_INCOMING_BATCH_SIZE; ++i) {
+        socklen_t sender_size = sizeof(sender);
+        ssize_t length = receive_udp_socket(server->socket, incoming_packet, DSU_INCOMING_BUFFER_SIZE, (struct sockaddr*) &sender, &sender_size);
+        if (length < 0) break;
+
+        if (handle_dsu_request(server, incoming_packet, length, &sender, timestamp)) ++requests;
+    }
+
+    return requests;
+}
+
+// Returns whether a client is subscribed to the controller data.
+bool update_dsu(dsu_server* server, uint64_t* timestamp, input_state* input, VPADTouchData* touchpad) {
+    // A request that is newer than the timestamp counts as current instead of wrapping around to a huge age.
+    server->subscribed = server->data_requested &&
+        (*timestamp < server->last_data_requested || *timestamp - server->last_data_requested < DATA_REQUEST_TIMEOUT);
+
+    if (server->subscribed) {
+        converted_sample converted;
+        convert_sample(&input->pad, &converted);
 
         uint8_t packet_size = pack_controller_data(
-            outgoing_packet, bswap32u(outgoing_packet_count), bswap64u(*timestamp),
-            accelerometerX, accelerometerY, accelerometerZ,
-            gyroscopePitch, gyroscopeYaw, gyroscopeRoll,
+            server->outgoing_packet, server->server_id, bswap32u(server->outgoing_packet_count), bswap64u(*timestamp),
+            converted.motion,
             touchpad->touched, bswap16u(touchpad->x), bswap16u(touchpad->y),
-            pad
+            input->latched_hold, &input->pad
         );
 
-        sendto(*socket, outgoing_packet, packet_size, 0, (const struct sockaddr*) &sender, sender_size);
-        ++outgoing_packet_count;
+        ssize_t result = send_udp_socket(server->socket, server->outgoing_packet, packet_size, (const struct sockaddr*) &server->subscriber, server->subscriber_size);
+        record_flight_event(FLIGHT_EVENT_DSU_SEND, result, 0);
+
+        if (result < 0) {
+            ++server->statistics.send_errors;
+        } else {
+            ++server->statistics.packets_sent;
+        }
+
+        ++server->outgoing_packet_count;
     }
+
+    return server->subscribed;
 }
+
+#endif
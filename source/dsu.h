@@ -1,3 +1,57 @@
+#pragma once
+
 #include <vpad/input.h>
+#include <arpa/inet.h>
+#include <stdbool.h>
+
+#include "input.h"
+
+// Port of the first DSU server and the highest amount of servers that can run at once.
+#define DSU_DEFAULT_PORT 26760
+#define DSU_MAX_SERVERS 4
+
+// Server ID of the first DSU server. Further servers count up from it.
+#define DSU_DEFAULT_SERVER_ID 0x01020304
+
+// Length of the outgoing packets, in bytes. Currently set to the absolute minimum.
+#define DSU_OUTGOING_BUFFER_SIZE 100
+
+// Requests are 28 bytes at most. A server with its own socket answers at most this many per call.
+#define DSU_INCOMING_BUFFER_SIZE 32
+#define DSU_INCOMING_BATCH_SIZE 16
+
+typedef struct {
+    uint32_t requests;
+    uint32_t packets_sent;
+    uint32_t send_errors;
+} dsu_statistics;
+
+// A DSU server with its own subscriber, packet counter, statistics and buffer, so several of them can run at once on
+// different ports, also on different threads. Besides the input they're given, they only share the flight recorder,
+// which is safe to record into from several threads. Calls for the same server must not run concurrently.
+typedef struct {
+    int socket;
+    bool owns_socket;
+    uint16_t port;
+    uint32_t server_id;
+
+    // Timestamps start at the console's boot, so 0 is a valid time and data_requested tells whether there was a request.
+    bool data_requested;
+    uint64_t last_data_requested;
+    // Wraps around after about 500 days at 100 packets per second, like the packet number of the protocol.
+    uint32_t outgoing_packet_count;
+    uint8_t outgoing_packet[DSU_OUTGOING_BUFFER_SIZE];
+
+    struct sockaddr_in subscriber;
+    socklen_t subscriber_size;
+    bool subscribed;
+
+    dsu_statistics statistics;
+} dsu_server;
 
-void update_dsu(int* socket, uint64_t* timestamp, VPADStatus* pad, VPADTouchData* touchpad);
\ No newline at end of file
+void init_dsu();
+bool init_dsu_server(dsu_server* server, const int socket, const uint16_t port, const uint32_t server_id);
+void destroy_dsu_server(dsu_server* server);
+bool handle_dsu_request(dsu_server* server, const uint8_t* incoming_packet, ssize_t request_length, const struct sockaddr_in* request_sender, uint64_t* timestamp);
+uint8_t receive_dsu_requests(dsu_server* server, uint64_t* timestamp);
+bool update_dsu(dsu_server* server, uint64_t* timestamp, input_state* input, VPADTouchData* touchpad);
@@ -0,0 +1,152 @@
+#include "flight_recorder.h"
+
+#include <coreinit/event.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <whb/sdcard.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Enough for a few seconds of events at the default update rate. Must be a power of two.
+#define FLIGHT_RECORDER_SIZE 2048
+
+// Dump files start with this magic string, followed by the amount of events (4 bytes) and the events, oldest first.
+// Every event consists of its time in microseconds (8 bytes), argument (4 bytes), detail (2 bytes), type (1 byte)
+// and a padding byte. All values are big endian. Use tools/flight_recorder_to_trace.py to convert dumps.
+#define FLIGHT_RECORDER_MAGIC "RWUGFR01"
+#define FLIGHT_RECORDER_HEADER_SIZE 12
+#define FLIGHT_RECORDER_EVENT_SIZE 16
+
+// Stack size of the thread that writes dumps, in bytes.
+#define WRITER_STACK_SIZE 0x8000
+
+// Priority of the thread that writes dumps. It's lower than the priorities of the main, sampling and audio threads,
+// so writing to the SD card never delays a sample.
+#define WRITER_THREAD_PRIORITY 20
+
+typedef struct {
+    OSTime time;
+    uint32_t argument;
+    uint16_t detail;
+    uint8_t type;
+    uint8_t padding;
+} flight_event;
+
+static flight_event events[FLIGHT_RECORDER_SIZE];
+static uint32_t event_count = 0;
+static uint32_t dump_count = 0;
+
+static OSThread thread __attribute__((aligned(8)));
+static uint8_t stack[WRITER_STACK_SIZE] __attribute__((aligned(16)));
+static OSEvent dump_event;
+static volatile bool running = false;
+
+// A dump is serialized into the buffer by the caller and written by the writer thread. Dumps that are requested
+// while the previous one is still being written are skipped.
+static uint8_t dump_buffer[FLIGHT_RECORDER_HEADER_SIZE + FLIGHT_RECORDER_SIZE * FLIGHT_RECORDER_EVENT_SIZE];
+static uint32_t dump_size = 0;
+static volatile bool dump_pending = false;
+
+// Number of the next dump file. Files of previous sessions are skipped, so they aren't overwritten.
+static uint32_t next_file_number = 0;
+
+// Safe to call from several threads, since every event reserves its own slot. A dump that runs at the same time may
+// contain a partially written event.
+void record_flight_event(const flight_event_type type, const uint32_t argument, const uint16_t detail) {
+    uint32_t index = __atomic_fetch_add(&event_count, 1, __ATOMIC_RELAXED);
+
+    flight_event* event = &events[index & (FLIGHT_RECORDER_SIZE - 1)];
+    event->time = OSGetSystemTime();
+    event->argument = argument;
+    event->detail = detail;
+    event->type = type;
+}
+
+static void write_dump() {
+    char path[128];
+    FILE* file;
+
+    for (;;) {
+        sprintf(path, "%s/wiiu/apps/RWUG/flight_recorder_%lu.bin", WHBGetSdCardMountPath(), (unsigned long) next_file_number++);
+
+        file = fopen(path, "rb");
+        if (file == NULL) break;
+        fclose(file);
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) return;
+
+    fwrite(dump_buffer, 1, dump_size, file);
+    fclose(file);
+}
+
+static int writer_thread(int argc, const char** argv) {
+    while (running) {
+        OSWaitEvent(&dump_event);
+
+        if (dump_pending) {
+            write_dump();
+            dump_pending = false;
+        }
+    }
+
+    return 0;
+}
+
+bool start_flight_recorder() {
+    OSInitEvent(&dump_event, false, OS_EVENT_MODE_AUTO);
+    running = true;
+
+    if (!OSCreateThread(&thread, writer_thread, 0, NULL, stack + WRITER_STACK_SIZE, WRITER_STACK_SIZE, WRITER_THREAD_PRIORITY, OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+        running = false;
+        return false;
+    }
+
+    OSSetThreadName(&thread, "RWUG flight recorder");
+    OSResumeThread(&thread);
+    return true;
+}
+
+// Waits until a pending dump has been written.
+void stop_flight_recorder() {
+    if (!running) return;
+
+    running = false;
+    OSSignalEvent(&dump_event);
+    OSJoinThread(&thread, NULL);
+}
+
+// Copies the events into the dump buffer, which only takes a few microseconds, and leaves writing it to the writer thread.
+// Returns false if the dump was skipped.
+bool dump_flight_recorder() {
+    if (!running || dump_pending) return false;
+
+    record_flight_event(FLIGHT_EVENT_DUMP, dump_count++, 0);
+
+    uint32_t count = event_count < FLIGHT_RECORDER_SIZE ? event_count : FLIGHT_RECORDER_SIZE;
+    memcpy(&dump_buffer[0], FLIGHT_RECORDER_MAGIC, 8);
+    memcpy(&dump_buffer[8], &count, sizeof(count));
+
+    uint8_t* position = &dump_buffer[FLIGHT_RECORDER_HEADER_SIZE];
+    for (uint32_t i = event_count - count; i != event_count; ++i) {
+        flight_event event = events[i & (FLIGHT_RECORDER_SIZE - 1)];
+
+        // The Wii U is big endian, so the values can be copied as they are.
+        uint64_t microseconds = OSTicksToMicroseconds(event.time);
+        memcpy(&position[0],  &microseconds,   sizeof(microseconds));
+        memcpy(&position[8],  &event.argument, sizeof(event.argument));
+        memcpy(&position[12], &event.detail,   sizeof(event.detail));
+        position[14] = event.type;
+        position[15] = event.padding;
+
+        position += FLIGHT_RECORDER_EVENT_SIZE;
+    }
+
+    dump_size = position - dump_buffer;
+    dump_pending = true;
+    OSSignalEvent(&dump_event);
+
+    return true;
+}
@@ -0,0 +1,18 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef enum {
+    FLIGHT_EVENT_LOOP_START       = 1, // argument: loop period in microseconds
+    FLIGHT_EVENT_VPAD_READ        = 2, // argument: amount of samples
+    FLIGHT_EVENT_RWUG_SEND        = 3, // argument: result of sendto()
+    FLIGHT_EVENT_DSU_SEND         = 4, // argument: result of sendto()
+    FLIGHT_EVENT_DSU_REQUEST      = 5, // argument: IPv4 address of the sender, detail: request type
+    FLIGHT_EVENT_RUMBLE           = 6, // argument: length in ms, detail: command
+    FLIGHT_EVENT_DEADLINE_OVERRUN = 7, // argument: delay in microseconds
+    FLIGHT_EVENT_DUMP             = 8  // argument: dump number of the session
+} flight_event_type;
+
+bool start_flight_recorder();
+void stop_flight_recorder();
+void record_flight_event(const flight_event_type type, const uint32_t argument, const uint16_t detail);
+bool dump_flight_recorder();
@@ -0,0 +1,200 @@
+#include "impairment.h"
+
+#ifdef NETWORK_IMPAIRMENT
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+// Emulates the loss, delay, jitter, reordering and duplication of a bad network in-process, so receivers and send
+// policies can be tested reproducibly without root or tc/netem. Only built with NETWORK_IMPAIRMENT, see udp_socket.c.
+
+// Maximum amount of delayed datagrams per direction. If a queue is full, outgoing datagrams are sent right away
+// and incoming datagrams are dropped.
+#define IMPAIRMENT_QUEUE_SIZE 256
+
+// Largest datagram that can be delayed, in bytes.
+#define IMPAIRMENT_MAX_SIZE 256
+
+// Datagrams that are held back are delayed by at least this, in microseconds.
+#define REORDERING_DELAY 20000
+
+typedef struct {
+    uint64_t due;
+    int udp_socket;
+    struct sockaddr_storage address;
+    socklen_t address_size;
+    uint16_t length;
+    uint8_t data[IMPAIRMENT_MAX_SIZE];
+} delayed_datagram;
+
+typedef struct {
+    delayed_datagram datagrams[IMPAIRMENT_QUEUE_SIZE];
+    uint16_t count;
+
+    // Every direction has its own random numbers, so the impairments of a datagram don't depend on the timing of the other direction.
+    uint32_t random_state;
+} datagram_queue;
+
+static impairment_settings settings;
+
+static datagram_queue outgoing;
+static datagram_queue incoming;
+
+// Monotonic, so setting the clock doesn't disturb the timing.
+static uint64_t get_time() {
+    struct timespec current_time;
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+    return (uint64_t) current_time.tv_sec * 1000000 + current_time.tv_nsec / 1000;
+}
+
+// xorshift32, which is good enough for impairments and gives the same sequence on every platform.
+static uint32_t next_random(datagram_queue* queue) {
+    queue->random_state ^= queue->random_state << 13;
+    queue->random_state ^= queue->random_state >> 17;
+    queue->random_state ^= queue->random_state << 5;
+    return queue->random_state;
+}
+
+static float next_probability(datagram_queue* queue) {
+    return (next_random(queue) >> 8) * (1.0f / (1 << 24));
+}
+
+void configure_impairment(const impairment_settings* new_settings) {
+    settings = *new_settings;
+
+    outgoing.count = 0;
+    outgoing.random_state = settings.seed != 0 ? settings.seed : 1;
+
+    incoming.count = 0;
+    incoming.random_state = settings.seed * 2654435761u + 1;
+    if (incoming.random_state == 0) incoming.random_state = 1;
+}
+
+static uint64_t get_delay(datagram_queue* queue) {
+    uint64_t delay = settings.delay;
+    if (settings.jitter != 0) delay += next_random(queue) % (settings.jitter + 1);
+    if (next_probability(queue) < settings.reordering) delay += REORDERING_DELAY + settings.jitter;
+
+    return delay;
+}
+
+static bool enqueue(datagram_queue* queue, const uint64_t due, const int udp_socket, const void* data, const size_t length, const struct sockaddr* address, const socklen_t address_size) {
+    if (queue->count == IMPAIRMENT_QUEUE_SIZE || length > IMPAIRMENT_MAX_SIZE || address_size > sizeof(struct sockaddr_storage)) return false;
+
+    delayed_datagram* datagram = &queue->datagrams[queue->count++];
+    datagram->due = due;
+    datagram->udp_socket = udp_socket;
+    datagram->length = length;
+    datagram->address_size = address_size;
+    memcpy(datagram->data, data, length);
+    memcpy(&datagram->address, address, address_size);
+
+    return true;
+}
+
+// Returns the index of the earliest datagram of the socket that is due, or -1. A socket of -1 matches every datagram.
+static int32_t find_due(const datagram_queue* queue, const uint64_t now, const int udp_socket) {
+    int32_t earliest = -1;
+    for (uint16_t i = 0; i < queue->count; ++i) {
+        if (udp_socket >= 0 && queue->datagrams[i].udp_socket != udp_socket) continue;
+        if (queue->datagrams[i].due <= now && (earliest < 0 || queue->datagrams[i].due < queue->datagrams[earliest].due)) earliest = i;
+    }
+
+    return earliest;
+}
+
+static void remove_datagram(datagram_queue* queue, const int32_t index) {
+    queue->datagrams[index] = queue->datagrams[--queue->count];
+}
+
+static void flush_outgoing(const uint64_t now) {
+    for (int32_t index = find_due(&outgoing, now, -1); index >= 0; index = find_due(&outgoing, now, -1)) {
+        delayed_datagram* datagram = &outgoing.datagrams[index];
+        sendto(datagram->udp_socket, datagram->data, datagram->length, 0, (const struct sockaddr*) &datagram->address, datagram->address_size);
+        remove_datagram(&outgoing, index);
+    }
+}
+
+// Dropped datagrams count as sent, like on a real network.
+ssize_t impaired_send(const int udp_socket, const void* data, const size_t length, const struct sockaddr* address, const socklen_t address_size) {
+    const uint64_t now = get_time();
+    flush_outgoing(now);
+
+    if (next_probability(&outgoing) < settings.loss) return length;
+
+    uint8_t copies = next_probability(&outgoing) < settings.duplication ? 2 : 1;
+    ssize_t result = length;
+    for (uint8_t i = 0; i < copies; ++i) {
+        uint64_t delay = get_delay(&outgoing);
+        if (delay == 0 || !enqueue(&outgoing, now + delay, udp_socket, data, length, address, address_size)) {
+            result = sendto(udp_socket, data, length, 0, address, address_size);
+        }
+    }
+
+    return result;
+}
+
+// Never blocks. Received datagrams are impaired when they arrive and returned once they are due.
+ssize_t impaired_receive(const int udp_socket, void* buffer, const size_t size, struct sockaddr* sender, socklen_t* sender_size) {
+    const uint64_t now = get_time();
+    flush_outgoing(now);
+
+    uint8_t data[IMPAIRMENT_MAX_SIZE];
+    struct sockaddr_storage address;
+    for (;;) {
+        socklen_t address_size = sizeof(address);
+        ssize_t length = recvfrom(udp_socket, data, sizeof(data), MSG_DONTWAIT, (struct sockaddr*) &address, &address_size);
+        if (length < 0) break;
+
+        if (next_probability(&incoming) < settings.loss) continue;
+
+        uint8_t copies = next_probability(&incoming) < settings.duplication ? 2 : 1;
+        for (uint8_t i = 0; i < copies; ++i) {
+            enqueue(&incoming, now + get_delay(&incoming), udp_socket, data, length, (const struct sockaddr*) &address, address_size);
+        }
+    }
+
+    // Datagrams of other sockets stay queued until those sockets are read.
+    int32_t index = find_due(&incoming, now, udp_socket);
+    if (index < 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+
+    delayed_datagram* datagram = &incoming.datagrams[index];
+    ssize_t length = datagram->length < size ? datagram->length : size;
+    memcpy(buffer, datagram->data, length);
+
+    if (sender != NULL) {
+        socklen_t address_size = datagram->address_size < *sender_size ? datagram->address_size : *sender_size;
+        memcpy(sender, &datagram->address, address_size);
+        *sender_size = datagram->address_size;
+    }
+
+    remove_datagram(&incoming, index);
+    return length;
+}
+
+static uint64_t get_queue_timeout(const datagram_queue* queue, const uint64_t now, const int udp_socket, uint64_t timeout) {
+    for (uint16_t i = 0; i < queue->count; ++i) {
+        if (udp_socket >= 0 && queue->datagrams[i].udp_socket != udp_socket) continue;
+
+        uint64_t due = queue->datagrams[i].due;
+        if (due <= now) return 0;
+        if (due - now < timeout) timeout = due - now;
+    }
+
+    return timeout;
+}
+
+// Shortens the wait timeout of a socket, so delayed datagrams are handled when they are due. Returns 0 if one is due already.
+// Outgoing datagrams of every socket count, since any receive sends them.
+uint32_t get_impairment_timeout(const int udp_socket, const uint32_t timeout_us) {
+    const uint64_t now = get_time();
+    return get_queue_timeout(&incoming, now, udp_socket, get_queue_timeout(&outgoing, now, -1, timeout_us));
+}
+
+#endif
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+typedef struct {
+    // Probabilities that a datagram is dropped, sent twice or held back behind later datagrams, in [0, 1].
+    float loss;
+    float duplication;
+    float reordering;
+
+    // Fixed and random additional delay of every datagram, in microseconds.
+    uint32_t delay;
+    uint32_t jitter;
+
+    // Seed of the random number generators. The same seed and traffic give the same impairments when sending.
+    // When receiving, they also depend on the order in which datagrams arrive.
+    uint32_t seed;
+} impairment_settings;
+
+void configure_impairment(const impairment_settings* settings);
+
+ssize_t impaired_send(const int udp_socket, const void* data, const size_t length, const struct sockaddr* address, const socklen_t address_size);
+ssize_t impaired_receive(const int udp_socket, void* buffer, const size_t size, struct sockaddr* sender, socklen_t* sender_size);
+uint32_t get_impairment_timeout(const int udp_socket, const uint32_t timeout_us);
@@ -0,0 +1,66 @@
+#include "input.h"
+
+#include <string.h>
+
+#include "remap.h"
+#include "sample_conversion.h"
+
+// Size of the sample buffer of VPAD.
+#define MAX_SAMPLES 16
+
+static VPADStatus samples[MAX_SAMPLES];
+static bool motion_averaging = false;
+
+void configure_input(const bool average_motion) {
+    motion_averaging = average_motion;
+}
+
+// Reads every sample that arrived since the last read, so short presses between two reads aren't lost.
+void read_input(input_state* input) {
+    VPADReadError error;
+    input->sample_count = VPADRead(VPAD_CHAN_0, samples, MAX_SAMPLES, &error);
+
+    input->pressed = 0;
+    input->released = 0;
+    memset(input->press_counts, 0, sizeof(input->press_counts));
+    memset(input->motion_sum, 0, sizeof(input->motion_sum));
+    input->motion_samples = 0;
+
+    if (input->sample_count <= 0) {
+        input->latched_hold = input->pad.hold;
+        return;
+    }
+
+    // Samples are ordered from newest to oldest. Everything after this only sees the remapped input.
+    for (int32_t i = input->sample_count - 1; i >= 0; --i) {
+        remap_buttons(&samples[i]);
+
+        uint32_t trigger = samples[i].trigger;
+
+        input->pressed  |= trigger;
+        input->released |= samples[i].release;
+
+        for (uint8_t button = 0; trigger != 0 && button < INPUT_COUNTED_BUTTONS; ++button, trigger >>= 1) {
+            if ((trigger & 1) && input->press_counts[button] < 255) ++input->press_counts[button];
+        }
+
+        if (motion_averaging) {
+            input->motion_sum[0] += samples[i].accelorometer.acc.x;
+            input->motion_sum[1] += samples[i].accelorometer.acc.y;
+            input->motion_sum[2] += samples[i].accelorometer.acc.z;
+            input->motion_sum[3] += samples[i].gyro.x;
+            input->motion_sum[4] += samples[i].gyro.y;
+            input->motion_sum[5] += samples[i].gyro.z;
+        }
+    }
+
+    remap_sticks(&samples[0]);
+
+    input->pad = samples[0];
+
+    if (motion_averaging) {
+        input->motion_samples = input->sample_count;
+        average_motion(&input->pad, input->motion_sum, input->motion_samples);
+    }
+    input->latched_hold = input->pad.hold | input->pressed;
+}
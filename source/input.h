@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vpad/input.h>
+#include <stdbool.h>
+
+// Press counts are kept for the buttons up to and including the left stick button.
+#define INPUT_COUNTED_BUTTONS 19
+
+// Accelerometer X, Y, Z and gyroscope X, Y, Z.
+#define INPUT_MOTION_VALUES 6
+
+typedef struct {
+    // Newest sample. Stays the same if no new sample arrived.
+    VPADStatus pad;
+
+    // Held buttons, including buttons that were pressed and released again since the last read.
+    uint32_t latched_hold;
+
+    // Edges of all samples since the last read.
+    uint32_t pressed;
+    uint32_t released;
+    uint8_t press_counts[INPUT_COUNTED_BUTTONS];
+
+    // Motion values summed over motion_samples samples since the last read. With motion averaging, pad contains their
+    // average instead of the newest values, so a packet covers all motion of its interval. Without, motion_samples is 0.
+    float motion_sum[INPUT_MOTION_VALUES];
+    int32_t motion_samples;
+
+    int32_t sample_count;
+} input_state;
+
+void configure_input(const bool average_motion);
+void read_input(input_state* input);
@@ -1,28 +1,80 @@
 #include <whb/proc.h>
 #include <whb/sdcard.h>
-#include <coreinit/screen.h>
-#include <coreinit/cache.h>
 #include <coreinit/thread.h>
-#include <malloc.h>
+#include <coreinit/time.h>
+#include <coreinit/mutex.h>
 #include <string.h>
 #include <stdio.h>
-#include <sys/time.h>
 
 #include "configuration.h"
+#include "text_ui.h"
 #include "udp_socket.h"
 #include "dsu.h"
 #include "rwug.h"
+#include "input.h"
+#include "power.h"
+#include "flight_recorder.h"
+#include "prediction.h"
+#include "sampling.h"
+#include "audio.h"
+#include "streaming.h"
 
-#define DSU_PORT 26760
 #define RWUG_PORT 4242
 
-#define DATA_UPDATE_RATE 10000
+// make DSU_ONLY=1 and make RWUG_ONLY=1 build a client with a single output. The mode is fixed, the other output
+// isn't compiled and the DSU-only client has no menu.
+#if defined(DSU_ONLY) && defined(RWUG_ONLY)
+#error "DSU_ONLY and RWUG_ONLY can't be combined."
+#elif defined(DSU_ONLY)
+#define FIXED_MODE 1
+#elif defined(RWUG_ONLY)
+#define FIXED_MODE 2
+#endif
+
+// Limits of the configured update interval, in microseconds. VPAD buffers 16 samples of 5 ms,
+// so longer intervals would lose samples.
+#define MIN_DATA_UPDATE_RATE 5000
+#define MAX_DATA_UPDATE_RATE 50000
+
+// Interval of the main loop while the sampling thread sends, in microseconds.
+#define HOUSEKEEPING_INTERVAL 50000
+
+// Time the menu waits for replies to a RWUG server discovery probe, in microseconds.
+#define DISCOVERY_TIMEOUT 500000
+
+// Size of the sample buffer of VPAD, which the menu reads at once.
+#define MENU_SAMPLES 16
+
+// Time that is waited for the first GamePad sample at startup, in microseconds.
+#define FIRST_SAMPLE_TIMEOUT 100000
+
+void print_header() {
+    print_text_ui(19, 1, " _____      ___   _  ___ ");
+    print_text_ui(19, 2, "| _ \\ \\    / / | | |/ __|");
+    print_text_ui(19, 3, "|   /\\ \\/\\/ /| |_| | (_ |");
+    print_text_ui(19, 4, "|_|_\\ \\_/\\_/  \\___/ \\___|");
+}
+
+void print_status(const char* ip_address, const bool enable_rwug, const dsu_server* dsu_servers, const uint8_t dsu_server_count, const bool menu_shown) {
+    clear_text_ui();
+    print_header();
+
+    uint8_t line = 9;
+    char sending_string[64];
+    if (enable_rwug) {
+        sprintf(sending_string, "Sending data to RWUG server at %s:%d.", ip_address, RWUG_PORT);
+        print_text_ui(0, line++, sending_string);
+    }
+    if (dsu_server_count > 0) {
+        int length = sprintf(sending_string, "Listening to DSU requests on %d", dsu_servers[0].port);
+        for (uint8_t i = 1; i < dsu_server_count; ++i) length += sprintf(&sending_string[length], ", %d", dsu_servers[i].port);
 
-void print_header(const OSScreenID buffer) {
-    OSScreenPutFontEx(buffer, 19, 1, " _____      ___   _  ___ ");
-    OSScreenPutFontEx(buffer, 19, 2, "| _ \\ \\    / / | | |/ __|");
-    OSScreenPutFontEx(buffer, 19, 3, "|   /\\ \\/\\/ /| |_| | (_ |");
-    OSScreenPutFontEx(buffer, 19, 4, "|_|_\\ \\_/\\_/  \\___/ \\___|");
+        sprintf(&sending_string[length], ".");
+        print_text_ui(0, line++, sending_string);
+    }
+
+    if (!menu_shown) print_text_ui(0, 15, "Hold any button while starting to open the menu.");
+    print_text_ui(0, 16, "HOME - Exit");
 }
 
 void reset_gyro_orientation() {
@@ -37,26 +89,68 @@ void reset_gyro_orientation() {
     VPADSetGyroDirReviseBase(VPAD_CHAN_0, &identity_base);
 }
 
+#ifndef DSU_ONLY
+bool discover_rwug_server(int* socket, uint8_t* raw_ip_address) {
+    send_discovery_probe(socket, RWUG_PORT);
+
+    uint8_t incoming_packet[INCOMING_BUFFER_SIZE];
+    struct sockaddr_in sender;
+
+    const OSTime deadline = OSGetSystemTime() + OSMicrosecondsToTicks(DISCOVERY_TIMEOUT);
+    for (OSTime now = OSGetSystemTime(); now < deadline; now = OSGetSystemTime()) {
+        if (wait_udp_socket(*socket, OSTicksToMicroseconds(deadline - now)) <= 0) break;
+
+        socklen_t sender_size = sizeof(sender);
+        ssize_t length = receive_udp_socket(*socket, incoming_packet, INCOMING_BUFFER_SIZE, (struct sockaddr*) &sender, &sender_size);
+
+        if (handle_discovery_reply(incoming_packet, length)) {
+            memcpy(raw_ip_address, &sender.sin_addr, 4);
+            return true;
+        }
+    }
+
+    return false;
+}
+#endif
+
+// Waits briefly for the first sample, because VPADRead() has no data right after VPADInit().
+uint32_t read_held_buttons() {
+    VPADStatus pad_data;
+    VPADReadError error;
+
+    const OSTime deadline = OSGetSystemTime() + OSMicrosecondsToTicks(FIRST_SAMPLE_TIMEOUT);
+    do {
+        VPADRead(VPAD_CHAN_0, &pad_data, 1, &error);
+        if (error == VPAD_READ_SUCCESS) return pad_data.hold;
+
+        OSSleepTicks(OSMillisecondsToTicks(1));
+    } while (OSGetSystemTime() < deadline);
+
+    return 0;
+}
+
+// Returns the buttons pressed in any sample since the last call. The menu runs once per frame, which spans several
+// samples, and a press only sets trigger in the sample it happened in.
+uint32_t read_triggered_buttons() {
+    static VPADStatus samples[MENU_SAMPLES];
+    VPADReadError error;
+
+    int32_t sample_count = VPADRead(VPAD_CHAN_0, samples, MENU_SAMPLES, &error);
+
+    uint32_t trigger = 0;
+    for (int32_t i = 0; i < sample_count; ++i) trigger |= samples[i].trigger;
+
+    return trigger;
+}
+
 int main() {
     WHBProcInit();
     WHBMountSdCard();
     VPADInit();
-    OSScreenInit();
+    init_text_ui();
 
     // VPADSetTVMenuInvalid(VPAD_CHAN_0, 1);
 
-    const uint32_t screenBufferSizeTV = OSScreenGetBufferSizeEx(SCREEN_TV);
-    const uint32_t screenBufferSizeDRC = OSScreenGetBufferSizeEx(SCREEN_DRC);
-    void* screenBufferTV = memalign(0x100, screenBufferSizeTV);
-    void* screenBufferDRC = memalign(0x100, screenBufferSizeDRC);
-
-    OSScreenSetBufferEx(SCREEN_TV, screenBufferTV);
-    OSScreenSetBufferEx(SCREEN_DRC, screenBufferDRC);
-    OSScreenEnableEx(SCREEN_TV, 1);
-    OSScreenEnableEx(SCREEN_DRC, 1);
-    OSScreenClearBufferEx(SCREEN_TV, 0x00000000);
-    OSScreenClearBufferEx(SCREEN_DRC, 0x00000000);
-
 
 
     char configuration_path[128];
@@ -66,58 +160,90 @@ int main() {
     uint8_t raw_ip_address[4];
     inet_pton(AF_INET, config.ip_address, &raw_ip_address);
 
+#ifdef FIXED_MODE
+    const uint8_t mode = FIXED_MODE;
+#else
     uint8_t mode = config.mode;
     const char* mode_to_string[] = { "DSU & Virtual Controller", "DSU", "Virtual Controller" };
+#endif
+
+    // Besides RWUG, the socket serves the first DSU server.
+    int udp_socket = init_udp_socket(config.dsu_ports[0]);
+
+#ifdef DSU_ONLY
+    // The menu only sets the RWUG server.
+    const bool show_menu = false;
+#else
+    // The menu is skipped if a configuration exists, unless any button is held during startup.
+    const bool show_menu = !config.loaded || !config.auto_start || read_held_buttons() != 0;
 
 
 
     char print_buffer[64];
     uint8_t selection = 0;
+    const char* search_status = "";
 
-    while (1) {
-        VPADStatus pad_data;
-        VPADRead(VPAD_CHAN_0, &pad_data, 1, NULL);
+    // The four parts of the IP address, followed by the mode.
+#ifdef FIXED_MODE
+    const uint8_t last_selection = 3;
+#else
+    const uint8_t last_selection = 4;
+#endif
 
-        if (pad_data.trigger & (VPAD_BUTTON_LEFT  | VPAD_STICK_L_EMULATION_LEFT  | VPAD_STICK_R_EMULATION_LEFT ) && selection > 0) --selection;
-        if (pad_data.trigger & (VPAD_BUTTON_RIGHT | VPAD_STICK_L_EMULATION_RIGHT | VPAD_STICK_R_EMULATION_RIGHT) && selection < 4) ++selection;
+    // Presses from before the menu opened, like the one of the button held to open it, don't count.
+    if (show_menu) read_triggered_buttons();
+
+    while (show_menu) {
+        const uint32_t trigger = read_triggered_buttons();
+
+        if (trigger & (VPAD_BUTTON_LEFT  | VPAD_STICK_L_EMULATION_LEFT  | VPAD_STICK_R_EMULATION_LEFT ) && selection > 0) --selection;
+        if (trigger & (VPAD_BUTTON_RIGHT | VPAD_STICK_L_EMULATION_RIGHT | VPAD_STICK_R_EMULATION_RIGHT) && selection < last_selection) ++selection;
 
         if (selection < 4) {
-            if (pad_data.trigger & (VPAD_BUTTON_UP   | VPAD_STICK_L_EMULATION_UP   | VPAD_STICK_R_EMULATION_UP  )) raw_ip_address[selection] = (raw_ip_address[selection] < 255) ? (raw_ip_address[selection] + 1) : 0;
-            if (pad_data.trigger & (VPAD_BUTTON_DOWN | VPAD_STICK_L_EMULATION_DOWN | VPAD_STICK_R_EMULATION_DOWN)) raw_ip_address[selection] = (raw_ip_address[selection] >   0) ? (raw_ip_address[selection] - 1) : 255;
-        } else {
-            if (pad_data.trigger & (VPAD_BUTTON_UP   | VPAD_STICK_L_EMULATION_UP   | VPAD_STICK_R_EMULATION_UP  )) mode = (mode < 2) ? (mode + 1) : 0;
-            if (pad_data.trigger & (VPAD_BUTTON_DOWN | VPAD_STICK_L_EMULATION_DOWN | VPAD_STICK_R_EMULATION_DOWN)) mode = (mode > 0) ? (mode - 1) : 2;
+            if (trigger & (VPAD_BUTTON_UP   | VPAD_STICK_L_EMULATION_UP   | VPAD_STICK_R_EMULATION_UP  )) raw_ip_address[selection] = (raw_ip_address[selection] < 255) ? (raw_ip_address[selection] + 1) : 0;
+            if (trigger & (VPAD_BUTTON_DOWN | VPAD_STICK_L_EMULATION_DOWN | VPAD_STICK_R_EMULATION_DOWN)) raw_ip_address[selection] = (raw_ip_address[selection] >   0) ? (raw_ip_address[selection] - 1) : 255;
         }
+#ifndef FIXED_MODE
+        else {
+            if (trigger & (VPAD_BUTTON_UP   | VPAD_STICK_L_EMULATION_UP   | VPAD_STICK_R_EMULATION_UP  )) mode = (mode < 2) ? (mode + 1) : 0;
+            if (trigger & (VPAD_BUTTON_DOWN | VPAD_STICK_L_EMULATION_DOWN | VPAD_STICK_R_EMULATION_DOWN)) mode = (mode > 0) ? (mode - 1) : 2;
+        }
+#endif
 
-        OSScreenClearBufferEx(SCREEN_TV, 0x00000000);
-        OSScreenClearBufferEx(SCREEN_DRC, 0x00000000);
+        clear_text_ui();
 
-        print_header(SCREEN_DRC);
-        OSScreenPutFontEx(SCREEN_DRC, 0, 7, "Use the D-Pad or sticks to adjust the selection and its value.");
+        print_header();
+        print_text_ui(0, 7, "Use the D-Pad or sticks to adjust the selection and its value.");
 
         sprintf(print_buffer, "RWUG IP   %3d.%3d.%3d.%3d", raw_ip_address[0], raw_ip_address[1], raw_ip_address[2], raw_ip_address[3]);
-        OSScreenPutFontEx(SCREEN_DRC, 0, 10, print_buffer);
+        print_text_ui(0, 10, print_buffer);
 
+#ifndef FIXED_MODE
         sprintf(print_buffer, "Mode      %s", mode_to_string[mode]);
-        OSScreenPutFontEx(SCREEN_DRC, 0, 12, print_buffer);
+        print_text_ui(0, 12, print_buffer);
+#endif
+
+        if (selection < 4) print_text_ui(10 + 4 * selection, 11, "---");
+        else print_text_ui(10, 13, "------------------------");
 
-        if (selection < 4) OSScreenPutFontEx(SCREEN_DRC, 10 + 4 * selection, 11, "---");
-        else OSScreenPutFontEx(SCREEN_DRC, 10, 13, "------------------------");
+        print_text_ui(32, 10, search_status);
 
-        OSScreenPutFontEx(SCREEN_DRC, 0, 15, "A    - Confirm");
-        OSScreenPutFontEx(SCREEN_DRC, 0, 16, "HOME - Exit");
+        print_text_ui(0, 14, "A    - Confirm");
+        print_text_ui(0, 15, "X    - Search for RWUG server");
+        print_text_ui(0, 16, "HOME - Exit");
 
-        DCFlushRange(screenBufferTV, screenBufferSizeTV);
-        DCFlushRange(screenBufferDRC, screenBufferSizeDRC);
-        OSScreenFlipBuffersEx(SCREEN_TV);
-        OSScreenFlipBuffersEx(SCREEN_DRC);
+        // Only redraws if something changed and limits the menu to the refresh rate of the display.
+        present_text_ui();
 
-        if (pad_data.trigger & VPAD_BUTTON_A) break;
+        if (trigger & VPAD_BUTTON_A) break;
+
+        if (trigger & VPAD_BUTTON_X) {
+            search_status = discover_rwug_server(&udp_socket, raw_ip_address) ? "(found)" : "(no reply)";
+        }
 
         if (!WHBProcIsRunning()) {
-            OSScreenShutdown();
-            free(screenBufferTV);
-            free(screenBufferDRC);
+            destroy_udp_socket(&udp_socket);
+            destroy_text_ui();
 
             VPADShutdown();
             WHBUnmountSdCard();
@@ -125,44 +251,19 @@ int main() {
 
             return 0;
         }
+
+        wait_text_ui_frame();
     }
+#endif
 
 
 
     reset_gyro_orientation();
 
-    char ip_address[16];
+    char ip_address[CONFIGURATION_ADDRESS_SIZE];
     sprintf(ip_address, "%d.%d.%d.%d", raw_ip_address[0], raw_ip_address[1], raw_ip_address[2], raw_ip_address[3]);
 
     const bool enable_rwug = mode == 0 || mode == 2;
-    const bool enable_dsu  = mode == 0 || mode == 1;
-
-    int udp_socket = init_udp_socket(DSU_PORT);
-
-    OSScreenClearBufferEx(SCREEN_TV, 0x00000000);
-    OSScreenClearBufferEx(SCREEN_DRC, 0x00000000);
-
-    print_header(SCREEN_DRC);
-
-    uint8_t line = 9;
-    char sending_string[64];
-    if (enable_rwug) {
-        sprintf(sending_string, "Sending data to RWUG server at %s:%d.", ip_address, RWUG_PORT);
-        OSScreenPutFontEx(SCREEN_DRC, 0, line++, sending_string);
-    }
-    if (enable_dsu) {
-        sprintf(sending_string, "Listening to DSU requests on %d.", DSU_PORT);
-        OSScreenPutFontEx(SCREEN_DRC, 0, line++, sending_string);
-    }
-
-    OSScreenPutFontEx(SCREEN_DRC, 0, 16, "HOME - Exit");
-
-    DCFlushRange(screenBufferTV, screenBufferSizeTV);
-    DCFlushRange(screenBufferDRC, screenBufferSizeDRC);
-    OSScreenFlipBuffersEx(SCREEN_TV);
-    OSScreenFlipBuffersEx(SCREEN_DRC);
-
-    save_configuration(configuration_path, ip_address, mode);
 
     struct sockaddr_in rwug_server_address;
     socklen_t rwug_server_address_size = sizeof(rwug_server_address);
@@ -172,33 +273,154 @@ int main() {
     rwug_server_address.sin_port = htons(RWUG_PORT);
     inet_pton(AF_INET, ip_address, &rwug_server_address.sin_addr);
 
+    struct sockaddr_in telemetry_address;
+    socklen_t telemetry_address_size = sizeof(telemetry_address);
+    memset(&telemetry_address, 0, telemetry_address_size);
+
+    telemetry_address.sin_family = AF_INET;
+    telemetry_address.sin_port = htons(config.telemetry_port);
+    const bool enable_telemetry = inet_pton(AF_INET, config.telemetry_address, &telemetry_address.sin_addr) == 1;
+
+    // Without a collector, telemetry is sent to the RWUG server if it supports it.
+    uint32_t update_rate = config.send_interval;
+    if (update_rate < MIN_DATA_UPDATE_RATE) update_rate = MIN_DATA_UPDATE_RATE;
+    if (update_rate > MAX_DATA_UPDATE_RATE) update_rate = MAX_DATA_UPDATE_RATE;
+
+    configure_prediction(config.prediction_latency, config.prediction_alpha, config.prediction_beta);
+    configure_remap(&config.remap);
+    configure_input(config.average_motion);
+#ifdef NETWORK_IMPAIRMENT
+    configure_impairment(&config.impairment);
+#endif
+
+    dsu_server dsu_servers[DSU_MAX_SERVERS];
+    uint8_t dsu_server_count = 0;
+#ifndef RWUG_ONLY
+    init_dsu();
+
+    // Further DSU servers have their own sockets. Ports that can't be opened are skipped.
+    const bool enable_dsu = mode == 0 || mode == 1;
+    for (uint8_t i = 0; enable_dsu && i < config.dsu_port_count; ++i) {
+        if (init_dsu_server(&dsu_servers[dsu_server_count], i == 0 ? udp_socket : -1, config.dsu_ports[i], DSU_DEFAULT_SERVER_ID + i)) ++dsu_server_count;
+    }
+#endif
+
+    // Start streaming to the saved server right away, but switch to another server if only that one answers the discovery probe.
+    discovery_state discovery;
+    memset(&discovery, 0, sizeof(discovery));
+    discovery.active = !show_menu && enable_rwug;
+    discovery.deadline = OSGetSystemTime() + OSMicrosecondsToTicks(DISCOVERY_TIMEOUT);
+#ifndef DSU_ONLY
+    configure_rwug(config.history_length, config.prediction_latency != 0, config.edges, config.microphone, !enable_telemetry, 1000000 / update_rate);
+    start_rwug_handshake();
+
+    if (discovery.active) send_discovery_probe(&udp_socket, RWUG_PORT);
+#endif
+
+    // The configuration is only written if it changed. Fixed builds keep the saved mode for the full client.
+    bool configuration_changed = !config.loaded || strcmp(config.ip_address, ip_address) != 0;
+    strcpy(config.ip_address, ip_address);
+#ifndef FIXED_MODE
+    configuration_changed = configuration_changed || config.mode != mode;
+    config.mode = mode;
+#endif
+    if (configuration_changed) save_configuration(configuration_path, &config);
+
+    print_status(ip_address, enable_rwug, dsu_servers, dsu_server_count, show_menu);
+    present_text_ui();
+
+
+
+    configure_power(config.idle_timeout, config.screen_timeout, get_microseconds());
+
+    send_state state;
+    memset(&state, 0, sizeof(state));
+    state.socket = &udp_socket;
+    state.enable_rwug = enable_rwug;
+    state.dsu_servers = dsu_servers;
+    state.dsu_server_count = dsu_server_count;
+    state.enable_telemetry = enable_telemetry;
+    state.rwug_server_address = &rwug_server_address;
+    state.rwug_server_address_size = rwug_server_address_size;
+    state.telemetry_address = &telemetry_address;
+    state.telemetry_address_size = telemetry_address_size;
+    state.power = POWER_ACTIVE;
+    state.update_rate = update_rate;
+    OSInitMutex(&state.mutex);
+
+#ifndef DSU_ONLY
+    // Audio runs on its own thread and socket and is only sent once the server agreed to receive it.
+    if (config.microphone && enable_rwug) start_audio(&rwug_server_address, &state.mutex);
+#endif
+
+    // Without the writer thread, the flight recorder still records but doesn't write dumps.
+    start_flight_recorder();
+
+    // Falls back to the timer if the sampling thread can't be started.
+    const bool sampling = config.sampling_callback && start_sampling(send_sampled, &state);
+
+    // The loop wakes up for datagrams on the shared socket and on the sockets of further DSU servers.
+    int waited_sockets[DSU_MAX_SERVERS + 1] = { udp_socket };
+    uint8_t waited_socket_count = 1;
+    for (uint8_t i = 0; i < dsu_server_count; ++i) {
+        if (dsu_servers[i].owns_socket) waited_sockets[waited_socket_count++] = dsu_servers[i].socket;
+    }
 
-
-    struct timeval current_time;
+    OSTime next_update = OSGetSystemTime();
 
     while (WHBProcIsRunning()) {
-        VPADStatus pad_data;
-        VPADRead(VPAD_CHAN_0, &pad_data, 1, NULL);
-
-        VPADTouchData touchpad_data;
-        VPADGetTPCalibratedPointEx(VPAD_CHAN_0, VPAD_TP_854X480, &touchpad_data, &pad_data.tpNormal);
+        // Sleep until the next sample is due, but answer DSU requests and force feedback commands as soon as they arrive.
+        // With the sampling callback, the sampling thread sends and this loop only answers datagrams and does housekeeping.
+        if (sampling) next_update = OSGetSystemTime() + OSMicrosecondsToTicks(HOUSEKEEPING_INTERVAL);
+
+        OSTime now = OSGetSystemTime();
+        while (now < next_update) {
+            int readable = wait_udp_sockets(waited_sockets, waited_socket_count, OSTicksToMicroseconds(next_update - now));
+            if (readable > 0) {
+                receive_datagrams(&state, &discovery);
+            } else if (readable < 0) {
+                OSSleepTicks(next_update - now);
+            }
+
+            // The saved server didn't answer in time, so the first other server that answered is used and saved.
+            if (update_discovery(&state, &discovery)) {
+                inet_ntop(AF_INET, &rwug_server_address.sin_addr, ip_address, sizeof(ip_address));
+                strcpy(config.ip_address, ip_address);
+                save_configuration(configuration_path, &config);
+
+                print_status(ip_address, enable_rwug, dsu_servers, dsu_server_count, show_menu);
+            }
+
+            now = OSGetSystemTime();
+
+            // Incoming requests end the idle state right away.
+            if (!sampling && state.power == POWER_IDLE && get_power_state() == POWER_ACTIVE) {
+                state.power = POWER_ACTIVE;
+                next_update = now;
+            }
+        }
 
-        gettimeofday(&current_time, NULL);
-        uint64_t microseconds = current_time.tv_sec * 1000000 + current_time.tv_usec;
+        if (!sampling) next_update = send_scheduled(&state, next_update, now);
 
-        if (enable_rwug) update_rwug(&udp_socket, &pad_data, &touchpad_data, &microseconds, (const struct sockaddr*) &rwug_server_address, rwug_server_address_size);
-        if (enable_dsu) update_dsu(&udp_socket, &microseconds, &pad_data, &touchpad_data);
+        write_flight_recorder_dumps(&state);
 
-        OSSleepTicks(OSMicrosecondsToTicks(DATA_UPDATE_RATE));
+        // Costs a single comparison of the line cache unless the status screen changed.
+        present_text_ui();
     }
 
+    stop_sampling();
+#ifndef DSU_ONLY
+    stop_audio();
+#endif
+    stop_flight_recorder();
 
-
+    restore_power();
+#ifndef RWUG_ONLY
+    for (uint8_t i = 0; i < dsu_server_count; ++i) destroy_dsu_server(&dsu_servers[i]);
+#endif
     destroy_udp_socket(&udp_socket);
 
-    OSScreenShutdown();
-    free(screenBufferTV);
-    free(screenBufferDRC);
+    destroy_text_ui();
 
     VPADShutdown();
     WHBUnmountSdCard();
@@ -0,0 +1,128 @@
+#include "microphone.h"
+
+#ifndef DSU_ONLY
+
+#include <stddef.h>
+
+// Captures the GamePad microphone with the MIC library. Other platforms get a stand-in that delivers samples at the
+// same rate in real time, so the audio path can be tested on a Linux PC. It plays the raw PCM file in the environment
+// variable RWUG_MICROPHONE_INPUT (signed 16 bit mono, native byte order) in a loop, or a 440 Hz tone.
+
+#ifdef __WIIU__
+
+#include <mic/mic.h>
+
+// Size of the ring buffer MIC writes into, in samples. About 300 ms.
+#define MICROPHONE_BUFFER_SIZE 0x2800
+
+static int16_t buffer[MICROPHONE_BUFFER_SIZE] __attribute__((aligned(0x40)));
+static MICWorkMemory work_memory;
+static MICHandle handle = -1;
+
+bool open_microphone() {
+    work_memory.sampleMaxCount = MICROPHONE_BUFFER_SIZE;
+    work_memory.sampleBuffer = buffer;
+
+    MICError error;
+    handle = MICInit(MIC_INSTANCE_0, 0, &work_memory, &error);
+    if (error != MIC_ERROR_OK) return false;
+
+    if (MICOpen(handle) != MIC_ERROR_OK) {
+        MICUninit(handle);
+        handle = -1;
+        return false;
+    }
+
+    return true;
+}
+
+// Copies the oldest samples if enough are buffered. age is the time since the first copied sample was captured, in microseconds.
+bool read_microphone(int16_t* samples, const uint16_t sample_count, uint32_t* age) {
+    MICStatus status;
+    if (MICGetStatus(handle, &status) != MIC_ERROR_OK || status.availableData < sample_count) return false;
+
+    for (uint16_t i = 0; i < sample_count; ++i) {
+        samples[i] = buffer[(status.bufferPos + i) % MICROPHONE_BUFFER_SIZE];
+    }
+
+    *age = (uint64_t) status.availableData * 1000000 / MICROPHONE_SAMPLE_RATE;
+
+    MICSetDataConsumed(handle, sample_count);
+    return true;
+}
+
+void close_microphone() {
+    if (handle < 0) return;
+
+    MICClose(handle);
+    MICUninit(handle);
+    handle = -1;
+}
+
+#else
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static FILE* input = NULL;
+static uint64_t start_time;
+static uint64_t consumed_samples;
+
+// Monotonic, so setting the clock doesn't disturb the timing.
+static uint64_t get_time() {
+    struct timespec current_time;
+    clock_gettime(CLOCK_MONOTONIC, &current_time);
+
+    return (uint64_t) current_time.tv_sec * 1000000 + current_time.tv_nsec / 1000;
+}
+
+bool open_microphone() {
+    const char* path = getenv("RWUG_MICROPHONE_INPUT");
+    if (path != NULL) {
+        input = fopen(path, "rb");
+        if (input == NULL) return false;
+    }
+
+    start_time = get_time();
+    consumed_samples = 0;
+    return true;
+}
+
+static int16_t read_sample() {
+    if (input == NULL) {
+        return (int16_t) (8192.0 * sin(2.0 * M_PI * 440.0 * consumed_samples / MICROPHONE_SAMPLE_RATE));
+    }
+
+    int16_t sample;
+    if (fread(&sample, sizeof(sample), 1, input) != 1) {
+        rewind(input);
+        if (fread(&sample, sizeof(sample), 1, input) != 1) return 0;
+    }
+
+    return sample;
+}
+
+bool read_microphone(int16_t* samples, const uint16_t sample_count, uint32_t* age) {
+    uint64_t captured_samples = (get_time() - start_time) * MICROPHONE_SAMPLE_RATE / 1000000;
+    uint64_t available = captured_samples - consumed_samples;
+    if (available < sample_count) return false;
+
+    for (uint16_t i = 0; i < sample_count; ++i) {
+        samples[i] = read_sample();
+        ++consumed_samples;
+    }
+
+    *age = available * 1000000 / MICROPHONE_SAMPLE_RATE;
+    return true;
+}
+
+void close_microphone() {
+    if (input != NULL) fclose(input);
+    input = NULL;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,9 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+// The GamePad microphone delivers signed 16 bit mono PCM at this rate, in Hz.
+#define MICROPHONE_SAMPLE_RATE 32000
+
+bool open_microphone();
+bool read_microphone(int16_t* samples, const uint16_t sample_count, uint32_t* age);
+void close_microphone();
@@ -0,0 +1,94 @@
+#include "power.h"
+
+#include <coreinit/screen.h>
+#include <math.h>
+
+// A server counts as active if it sent anything within this time, in microseconds.
+#define SERVER_ACTIVITY_TIMEOUT 5000000
+
+// Sticks and gyroscope rates below these thresholds count as resting. The gyroscope is in rotations per second.
+#define STICK_THRESHOLD 0.1f
+#define GYRO_THRESHOLD 0.02f
+
+static power_state state = POWER_ACTIVE;
+
+// Timeouts in microseconds. 0 disables idling or turning off the screen.
+static uint64_t idle_timeout = 0;
+static uint64_t screen_timeout = 0;
+
+// Requests and server activity only keep the full rate, the screen timeout only counts from the last input.
+static uint64_t last_activity = 0;
+static uint64_t last_input = 0;
+static uint64_t last_server_activity = 0;
+static bool screen_on = true;
+
+static void set_screen(const bool on) {
+    if (screen_on == on) return;
+
+    VPADSetLcdMode(VPAD_CHAN_0, on ? VPAD_LCD_ON : VPAD_LCD_STANDBY);
+    screen_on = on;
+}
+
+// The TV only shows a blank screen while streaming, so it is turned off right away.
+void configure_power(const uint32_t idle_timeout_seconds, const uint32_t screen_timeout_seconds, const uint64_t microseconds) {
+    idle_timeout = (uint64_t) idle_timeout_seconds * 1000000;
+    screen_timeout = (uint64_t) screen_timeout_seconds * 1000000;
+    last_activity = microseconds;
+    last_input = microseconds;
+
+    OSScreenEnableEx(SCREEN_TV, 0);
+}
+
+void restore_power() {
+    set_screen(true);
+    OSScreenEnableEx(SCREEN_TV, 1);
+}
+
+static bool is_input_active(const input_state* input) {
+    const VPADStatus* pad = &input->pad;
+
+    if (input->latched_hold != 0 || input->released != 0) return true;
+
+    if (fabsf(pad->leftStick.x)  > STICK_THRESHOLD || fabsf(pad->leftStick.y)  > STICK_THRESHOLD ||
+        fabsf(pad->rightStick.x) > STICK_THRESHOLD || fabsf(pad->rightStick.y) > STICK_THRESHOLD) return true;
+
+    return fabsf(pad->gyro.x) > GYRO_THRESHOLD || fabsf(pad->gyro.y) > GYRO_THRESHOLD || fabsf(pad->gyro.z) > GYRO_THRESHOLD;
+}
+
+// Idle means that nobody is listening and the GamePad is resting, so samples are only sent at a heartbeat rate.
+power_state update_power(const input_state* input, const bool has_listeners, const uint64_t microseconds) {
+    if (is_input_active(input)) {
+        last_activity = microseconds;
+        last_input = microseconds;
+
+        // Only buttons turn the screen back on, so the GamePad can be moved while the screen stays off.
+        if (input->pressed != 0) set_screen(true);
+    }
+
+    const bool server_active = last_server_activity != 0 && microseconds - last_server_activity < SERVER_ACTIVITY_TIMEOUT;
+    const uint64_t inactive_time = microseconds - last_activity;
+
+    if (screen_timeout != 0 && microseconds - last_input > screen_timeout) set_screen(false);
+
+    state = idle_timeout != 0 && inactive_time > idle_timeout && !has_listeners && !server_active ? POWER_IDLE : POWER_ACTIVE;
+    return state;
+}
+
+// Returns true if an incoming request ended the idle state. Requests don't turn the screen back on or delay turning it off.
+bool wake_power(const uint64_t microseconds) {
+    last_activity = microseconds;
+
+    bool woken = state == POWER_IDLE;
+    state = POWER_ACTIVE;
+
+    return woken;
+}
+
+power_state get_power_state() {
+    return state;
+}
+
+void report_server_activity(const uint64_t microseconds) {
+    last_server_activity = microseconds;
+    wake_power(microseconds);
+}
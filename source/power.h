@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "input.h"
+
+typedef enum {
+    POWER_ACTIVE,
+    POWER_IDLE
+} power_state;
+
+void configure_power(const uint32_t idle_timeout, const uint32_t screen_timeout, const uint64_t microseconds);
+void restore_power();
+
+power_state update_power(const input_state* input, const bool has_listeners, const uint64_t microseconds);
+bool wake_power(const uint64_t microseconds);
+power_state get_power_state();
+void report_server_activity(const uint64_t microseconds);
@@ -0,0 +1,101 @@
+#include "prediction.h"
+
+#include <math.h>
+
+#include "sample_conversion.h"
+
+// Samples that are further apart than this many packet intervals reset the filters, but at least MIN_RESET_INTERVAL
+// microseconds, so jitter of slow packet rates doesn't reset them.
+#define RESET_PACKET_INTERVALS 4
+#define MIN_RESET_INTERVAL 100000
+
+typedef struct {
+    float value;
+    float velocity;
+} alpha_beta_filter;
+
+static uint32_t prediction_latency = 0;
+static bool latency_measured = false;
+static float filter_alpha = 0.5f;
+static float filter_beta = 0.1f;
+
+static alpha_beta_filter stick_filters[4];
+static float orientation[3];
+static uint64_t last_sample = 0;
+static uint64_t reset_interval = MIN_RESET_INTERVAL;
+
+void configure_prediction(const uint32_t latency, const float alpha, const float beta) {
+    latency_measured = latency == PREDICTION_LATENCY_MEASURED;
+    prediction_latency = latency_measured ? 0 : latency;
+    filter_alpha = alpha;
+    filter_beta = beta;
+}
+
+void set_prediction_latency(const uint32_t latency) {
+    prediction_latency = latency;
+}
+
+uint32_t get_prediction_latency() {
+    return prediction_latency;
+}
+
+bool is_prediction_latency_measured() {
+    return latency_measured;
+}
+
+// Interval between two packets at the negotiated rate, in microseconds.
+void set_prediction_packet_interval(const uint32_t interval) {
+    reset_interval = (uint64_t) interval * RESET_PACKET_INTERVALS;
+    if (reset_interval < MIN_RESET_INTERVAL) reset_interval = MIN_RESET_INTERVAL;
+}
+
+// Estimates value and velocity of a noisy signal. dt is in seconds.
+static void update_alpha_beta_filter(alpha_beta_filter* filter, const float measurement, const float dt) {
+    float estimate = filter->value + filter->velocity * dt;
+    float residual = measurement - estimate;
+
+    filter->value = estimate + filter_alpha * residual;
+    filter->velocity += filter_beta * residual / dt;
+}
+
+static float wrap_degrees(const float angle) {
+    return angle - 360.0f * floorf((angle + 180.0f) / 360.0f);
+}
+
+static float clamp_stick(const float value) {
+    return fminf(fmaxf(value, -1.0f), 1.0f);
+}
+
+void update_prediction(VPADStatus* pad, const uint64_t microseconds, prediction* result) {
+    const float sticks[4] = { pad->leftStick.x, pad->leftStick.y, pad->rightStick.x, pad->rightStick.y };
+
+    float rates[3];
+    convert_gyro_rates(pad, rates);
+
+    uint64_t interval = microseconds - last_sample;
+    if (last_sample == 0 || interval == 0 || interval > reset_interval) {
+        for (uint8_t i = 0; i < 4; ++i) {
+            stick_filters[i].value = sticks[i];
+            stick_filters[i].velocity = 0.0f;
+        }
+    } else {
+        const float dt = interval / 1000000.0f;
+
+        for (uint8_t i = 0; i < 4; ++i) update_alpha_beta_filter(&stick_filters[i], sticks[i], dt);
+        for (uint8_t i = 0; i < 3; ++i) orientation[i] = wrap_degrees(orientation[i] + rates[i] * dt);
+    }
+
+    last_sample = microseconds;
+
+    // Constant velocity extrapolation by the latency.
+    const float latency = prediction_latency / 1000000.0f;
+
+    for (uint8_t i = 0; i < 3; ++i) {
+        result->orientation[i] = orientation[i];
+        result->predicted_orientation[i] = wrap_degrees(orientation[i] + rates[i] * latency);
+    }
+
+    for (uint8_t i = 0; i < 4; ++i) {
+        result->predicted_sticks[i] = clamp_stick(stick_filters[i].value + stick_filters[i].velocity * latency);
+    }
+}
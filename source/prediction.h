@@ -0,0 +1,22 @@
+#include <vpad/input.h>
+#include <stdbool.h>
+
+typedef struct {
+    // Orientation integrated from the gyroscope and its extrapolation, in degrees (pitch, yaw, roll).
+    float orientation[3];
+    float predicted_orientation[3];
+
+    // Extrapolated stick values (left X, left Y, right X, right Y).
+    float predicted_sticks[4];
+} prediction;
+
+// Measures the latency during the RWUG handshake instead of using a fixed one.
+#define PREDICTION_LATENCY_MEASURED 0xFFFFFFFF
+
+void configure_prediction(const uint32_t latency, const float alpha, const float beta);
+void set_prediction_latency(const uint32_t latency);
+uint32_t get_prediction_latency();
+bool is_prediction_latency_measured();
+void set_prediction_packet_interval(const uint32_t interval);
+
+void update_prediction(VPADStatus* pad, const uint64_t microseconds, prediction* result);
@@ -0,0 +1,123 @@
+#include "remap.h"
+
+#include <math.h>
+#include <string.h>
+
+typedef struct {
+    const char* name;
+    uint32_t button;
+} button_name;
+
+// Names of the buttons in the [remap] section of the configuration.
+static const button_name button_names[] = {
+    { "a", VPAD_BUTTON_A },
+    { "b", VPAD_BUTTON_B },
+    { "x", VPAD_BUTTON_X },
+    { "y", VPAD_BUTTON_Y },
+    { "left", VPAD_BUTTON_LEFT },
+    { "right", VPAD_BUTTON_RIGHT },
+    { "up", VPAD_BUTTON_UP },
+    { "down", VPAD_BUTTON_DOWN },
+    { "zl", VPAD_BUTTON_ZL },
+    { "zr", VPAD_BUTTON_ZR },
+    { "l", VPAD_BUTTON_L },
+    { "r", VPAD_BUTTON_R },
+    { "plus", VPAD_BUTTON_PLUS },
+    { "minus", VPAD_BUTTON_MINUS },
+    { "home", VPAD_BUTTON_HOME },
+    { "tv", VPAD_BUTTON_TV },
+    { "stick_l", VPAD_BUTTON_STICK_L },
+    { "stick_r", VPAD_BUTTON_STICK_R },
+    { "none", 0 }
+};
+
+static button_table buttons;
+
+// Two additional entries, so the interpolation of the value 1 doesn't need a bounds check.
+static float stick_table[REMAP_STICK_STEPS + 2];
+
+void reset_remap_settings(remap_settings* settings) {
+    for (uint8_t bit = 0; bit < REMAP_BUTTONS; ++bit) {
+        settings->buttons[bit] = 1u << bit;
+    }
+
+    settings->stick_deadzone = 0.0f;
+    settings->stick_exponent = 1.0f;
+}
+
+static const button_name* find_button(const char* name) {
+    for (uint8_t i = 0; i < sizeof(button_names) / sizeof(button_names[0]); ++i) {
+        if (strcmp(button_names[i].name, name) == 0) return &button_names[i];
+    }
+
+    return NULL;
+}
+
+// Reports the button as the target button. Several buttons can share a target.
+bool set_button_remap(remap_settings* settings, const char* button, const char* target) {
+    const button_name* source = find_button(button);
+    const button_name* destination = find_button(target);
+    if (source == NULL || destination == NULL || source->button == 0) return false;
+
+    settings->buttons[__builtin_ctz(source->button)] = destination->button;
+    return true;
+}
+
+void build_button_table(button_table* table, const uint32_t* buttons) {
+    for (uint8_t byte = 0; byte < 4; ++byte) {
+        for (uint16_t value = 0; value < 256; ++value) {
+            uint32_t result = 0;
+            for (uint8_t bit = 0; bit < 8; ++bit) {
+                if (value & (1 << bit)) result |= buttons[byte * 8 + bit];
+            }
+
+            table->bytes[byte][value] = result;
+        }
+    }
+}
+
+uint32_t lookup_button_table(const button_table* table, const uint32_t bitfield) {
+    return table->bytes[0][(bitfield      ) & 0xFF] |
+           table->bytes[1][(bitfield >> 8 ) & 0xFF] |
+           table->bytes[2][(bitfield >> 16) & 0xFF] |
+           table->bytes[3][(bitfield >> 24)       ];
+}
+
+static float get_stick_response(const float value, const float deadzone, const float exponent) {
+    float magnitude = (fabsf(value) - deadzone) / (1.0f - deadzone);
+    if (magnitude <= 0.0f) return 0.0f;
+
+    return copysignf(powf(fminf(magnitude, 1.0f), exponent), value);
+}
+
+void configure_remap(const remap_settings* settings) {
+    build_button_table(&buttons, settings->buttons);
+
+    float deadzone = fminf(fmaxf(settings->stick_deadzone, 0.0f), 0.99f);
+    for (uint16_t step = 0; step <= REMAP_STICK_STEPS; ++step) {
+        float value = (float) step / (REMAP_STICK_STEPS / 2) - 1.0f;
+        stick_table[step] = get_stick_response(value, deadzone, settings->stick_exponent);
+    }
+    stick_table[REMAP_STICK_STEPS + 1] = stick_table[REMAP_STICK_STEPS];
+}
+
+static float remap_stick(const float value) {
+    float position = (fminf(fmaxf(value, -1.0f), 1.0f) + 1.0f) * (REMAP_STICK_STEPS / 2);
+    int32_t step = (int32_t) position;
+    float fraction = position - step;
+
+    return stick_table[step] + (stick_table[step + 1] - stick_table[step]) * fraction;
+}
+
+void remap_buttons(VPADStatus* sample) {
+    sample->hold    = lookup_button_table(&buttons, sample->hold);
+    sample->trigger = lookup_button_table(&buttons, sample->trigger);
+    sample->release = lookup_button_table(&buttons, sample->release);
+}
+
+void remap_sticks(VPADStatus* sample) {
+    sample->leftStick.x  = remap_stick(sample->leftStick.x);
+    sample->leftStick.y  = remap_stick(sample->leftStick.y);
+    sample->rightStick.x = remap_stick(sample->rightStick.x);
+    sample->rightStick.y = remap_stick(sample->rightStick.y);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <vpad/input.h>
+
+// Amount of bits of the VPAD button bitfield.
+#define REMAP_BUTTONS 32
+
+// Size of the stick response table. Stick values in [-1, 1] are interpolated between its entries.
+#define REMAP_STICK_STEPS 256
+
+typedef struct {
+    // Buttons every bit of the VPAD button bitfield is reported as. 0 disables the button.
+    uint32_t buttons[REMAP_BUTTONS];
+
+    // Stick values below the deadzone are reported as 0, the remaining range is scaled to [0, 1] and raised to the exponent.
+    float stick_deadzone;
+    float stick_exponent;
+} remap_settings;
+
+// Maps every byte of a 32 bit bitfield to the combined bits of its buttons, so a bitfield is remapped with 4 lookups.
+typedef struct {
+    uint32_t bytes[4][256];
+} button_table;
+
+void reset_remap_settings(remap_settings* settings);
+bool set_button_remap(remap_settings* settings, const char* button, const char* target);
+
+void build_button_table(button_table* table, const uint32_t* buttons);
+uint32_t lookup_button_table(const button_table* table, const uint32_t bitfield);
+
+void configure_remap(const remap_settings* settings);
+void remap_buttons(VPADStatus* sample);
+void remap_sticks(VPADStatus* sample);
@@ -1,8 +1,15 @@
 #include "rwug.h"
 
+#ifndef DSU_ONLY
+
 #include <string.h>
 
 #include "byte_swap.h"
+#include "sample_conversion.h"
+#include "flight_recorder.h"
+#include "prediction.h"
+#include "telemetry.h"
+#include "udp_socket.h"
 
 #define RWUG_PLAY 0x01
 #define RWUG_STOP 0x02
@@ -10,24 +17,256 @@
 #define RWUG_OUT_SIZE 58
 #define RWUG_IN_SIZE 4
 
-void pack_gamepad_data(VPADStatus* pad, VPADTouchData* touchpad, uint8_t* packet, uint64_t* microseconds) {
-    float accelerometerX = bswap32f(-pad->accelorometer.acc.x);
-    float accelerometerY = bswap32f( pad->accelorometer.acc.y);
-    float accelerometerZ = bswap32f(-pad->accelorometer.acc.z);
+// Extensions are appended to the 58 bytes of the legacy packet, so servers that don't know them can ignore them.
+// Every extension starts with its type (1 byte) and the length of its payload (1 byte).
+#define RWUG_EXTENSION_HEADER_SIZE 2
+#define RWUG_MAX_OUT_SIZE 256
+
+// Sequence number (4 bytes), amount of history entries (1 byte) and the button and stick state of the previous packets,
+// newest first. Entries contain the held button bitfield (4 bytes) and the stick values scaled to [-127, 127] (1 byte each).
+// A server that notices a gap in the sequence numbers can rebuild the missing inputs from the history of the next packet.
+#define RWUG_EXTENSION_SEQUENCE 0x01
+#define RWUG_HISTORY_ENTRY_SIZE 8
+#define RWUG_MAX_HISTORY_LENGTH 8
+
+// Prediction latency in microseconds (4 bytes), orientation integrated from the gyroscope (3 * 4 bytes),
+// the orientation extrapolated by the latency (3 * 4 bytes) and the extrapolated stick values (4 * 4 bytes).
+// Angles are in degrees with the same axes as the gyroscope data. The server can choose between these and the raw values.
+#define RWUG_EXTENSION_PREDICTION 0x02
+#define RWUG_PREDICTION_SIZE 44
+
+// Buttons that were pressed (4 bytes) and released (4 bytes) since the previous packet, and how often each of the
+// first 19 buttons (VPAD bit order) was pressed, as 4 bit counts that saturate at 15 (10 bytes, lower nibble first).
+// Presses that start and end between two packets are also reported as held in the packet's button bitfield.
+#define RWUG_EXTENSION_EDGES 0x03
+#define RWUG_EDGES_SIZE 18
+
+// Audio of the microphone is sent in separate packets, which start with the magic string "RWUGAUDI" (8 bytes), followed by a
+// sequence number (4 bytes), the capture time of the first sample in microseconds on the time base of the input packets
+// (8 bytes), the sample rate in Hz (2 bytes), the amount of samples (2 bytes) and the samples as signed 16 bit mono PCM.
+#define RWUG_AUDIO "RWUGAUDI"
+
+// At the start of a session, the client sends a hello with its protocol version (2 bytes), the features it would like to use
+// (4 bytes) and its packet rate in Hz (2 bytes). The server answers with an acknowledgement of the same layout, which
+// contains the features it supports and the highest rate it accepts. Both sides then use the common features and the lower rate.
+// Servers that don't answer are legacy servers, which only receive the packet without extensions.
+#define RWUG_PROTOCOL_VERSION 2
+#define RWUG_HELLO "RWUGHELO"
+#define RWUG_ACK "RWUGHACK"
+#define RWUG_HANDSHAKE_SIZE 16
+
+// Time between hello retries, in microseconds, and the amount of hellos before falling back to the legacy packet.
+// Afterwards, hellos are repeated at a low rate until the server answers, since it may start after the client.
+#define RWUG_HANDSHAKE_INTERVAL 250000
+#define RWUG_HANDSHAKE_ATTEMPTS 4
+#define RWUG_HANDSHAKE_RETRY_INTERVAL 5000000
+
+// Servers answer a broadcasted probe with a reply of the same length, which reveals their address.
+#define RWUG_DISCOVERY_PROBE "RWUGDISC"
+#define RWUG_DISCOVERY_REPLY "RWUGHERE"
+#define RWUG_DISCOVERY_SIZE 8
+
+typedef struct {
+    uint32_t hold;
+    int8_t sticks[4];
+} rwug_history_entry;
+
+static uint8_t history_length = 0;
+static rwug_history_entry history[RWUG_MAX_HISTORY_LENGTH];
+static uint8_t history_position = 0;
+static uint32_t outgoing_sequence = 0;
+
+static uint32_t requested_features = 0;
+static uint32_t enabled_features = 0;
+static uint16_t client_rate = 0;
+
+// Packets are only sent every rate_divider updates, if the server accepts less than the client's rate.
+static uint8_t rate_divider = 1;
+static uint8_t rate_counter = 0;
+
+// Edges of updates that didn't send a packet due to the rate divider.
+static uint32_t pending_pressed = 0;
+static uint32_t pending_released = 0;
+static uint8_t pending_press_counts[INPUT_COUNTED_BUTTONS];
+
+// Motion of updates that didn't send a packet, so the packet's average covers the whole interval.
+static float pending_motion_sum[INPUT_MOTION_VALUES];
+static int32_t pending_motion_samples = 0;
+
+static uint8_t handshake_attempts = 0;
+static uint64_t last_hello = 0;
+
+// The acknowledgement doesn't tell which hello it answers, so the round trip is only measured if a single hello was sent.
+static uint32_t hellos_sent = 0;
+static bool acknowledged = false;
+
+void configure_rwug(const uint8_t requested_history_length, const bool request_prediction, const bool request_edges, const bool request_audio, const bool request_telemetry, const uint16_t rate) {
+    history_length = requested_history_length < RWUG_MAX_HISTORY_LENGTH ? requested_history_length : RWUG_MAX_HISTORY_LENGTH;
+
+    requested_features = 0;
+    if (history_length > 0) requested_features |= RWUG_FEATURE_SEQUENCE;
+    if (request_prediction) requested_features |= RWUG_FEATURE_ORIENTATION;
+    if (request_edges)      requested_features |= RWUG_FEATURE_EDGES;
+    if (request_audio)      requested_features |= RWUG_FEATURE_AUDIO;
+
+    // Telemetry alone doesn't start a handshake, so legacy servers never receive a hello unless extensions are configured.
+    if (request_telemetry && requested_features != 0) requested_features |= RWUG_FEATURE_TELEMETRY;
+
+    client_rate = rate;
+}
+
+void start_rwug_handshake() {
+    enabled_features = 0;
+    rate_divider = 1;
+    handshake_attempts = 0;
+    last_hello = 0;
+    hellos_sent = 0;
+    acknowledged = false;
+
+    if (client_rate > 0) set_prediction_packet_interval(1000000 / client_rate);
+}
+
+uint32_t get_rwug_features() {
+    return enabled_features;
+}
+
+// Only servers that answered the hello send anything, so only their silence means that nobody is listening.
+bool is_rwug_handshake_acknowledged() {
+    return acknowledged;
+}
+
+static void send_hello(int* socket, const struct sockaddr* server_address, const socklen_t server_address_size, const uint64_t microseconds) {
+    uint8_t packet[RWUG_HANDSHAKE_SIZE];
+    memcpy(&packet[0], RWUG_HELLO, 8);
+
+    uint16_t version = bswap16u(RWUG_PROTOCOL_VERSION);
+    uint32_t features = bswap32u(requested_features);
+    uint16_t rate = bswap16u(client_rate);
+
+    memcpy(&packet[8],  &version,  sizeof(version));
+    memcpy(&packet[10], &features, sizeof(features));
+    memcpy(&packet[14], &rate,     sizeof(rate));
+
+    send_udp_socket(*socket, packet, RWUG_HANDSHAKE_SIZE, server_address, server_address_size);
+
+    last_hello = microseconds;
+    ++hellos_sent;
+    if (handshake_attempts < RWUG_HANDSHAKE_ATTEMPTS) ++handshake_attempts;
+}
+
+bool handle_handshake_ack(const uint8_t* incoming_packet, ssize_t packet_length, const uint64_t microseconds) {
+    if (packet_length != RWUG_HANDSHAKE_SIZE || memcmp(incoming_packet, RWUG_ACK, 8) != 0) return false;
+
+    uint16_t version;
+    uint32_t features;
+    uint16_t rate;
+
+    memcpy(&version,  &incoming_packet[8],  sizeof(version));
+    memcpy(&features, &incoming_packet[10], sizeof(features));
+    memcpy(&rate,     &incoming_packet[14], sizeof(rate));
+
+    version = bswap16u(version);
+    rate = bswap16u(rate);
+
+    // Version 1 is the legacy protocol without extensions.
+    enabled_features = version >= 2 ? requested_features & bswap32u(features) : 0;
+
+    rate_divider = 1;
+    if (rate > 0 && rate < client_rate) rate_divider = (client_rate + rate - 1) / rate;
+    if (client_rate > 0) set_prediction_packet_interval(1000000 * rate_divider / client_rate);
+
+    // Half the round trip time of the handshake approximates the latency of a packet. After a retry, the acknowledgement
+    // may answer an earlier hello, which would give a too short round trip.
+    if (is_prediction_latency_measured() && hellos_sent == 1) {
+        set_prediction_latency((microseconds - last_hello) / 2);
+    }
+
+    acknowledged = true;
+    return true;
+}
+
+uint8_t pack_sequence_extension(VPADStatus* pad, const uint32_t hold, uint8_t* extension) {
+    uint8_t payload_length = 5 + history_length * RWUG_HISTORY_ENTRY_SIZE;
+
+    extension[0] = RWUG_EXTENSION_SEQUENCE;
+    extension[1] = payload_length;
+
+    uint32_t sequence = bswap32u(outgoing_sequence);
+    memcpy(&extension[2], &sequence, sizeof(sequence));
+    extension[6] = history_length;
+
+    uint8_t* entry = &extension[7];
+    for (uint8_t i = 1; i <= history_length; ++i, entry += RWUG_HISTORY_ENTRY_SIZE) {
+        const rwug_history_entry* previous = &history[(history_position + RWUG_MAX_HISTORY_LENGTH - i) % RWUG_MAX_HISTORY_LENGTH];
+
+        uint32_t hold = bswap32u(previous->hold);
+        memcpy(&entry[0], &hold, sizeof(hold));
+        memcpy(&entry[4], previous->sticks, sizeof(previous->sticks));
+    }
+
+    // Remember the current state for the history of the following packets.
+    rwug_history_entry* current = &history[history_position];
+    current->hold = hold;
+    current->sticks[0] = (int8_t) (pad->leftStick.x  * 127);
+    current->sticks[1] = (int8_t) (pad->leftStick.y  * 127);
+    current->sticks[2] = (int8_t) (pad->rightStick.x * 127);
+    current->sticks[3] = (int8_t) (pad->rightStick.y * 127);
 
-    // Accelerometer data (4 bytes each).
-    memcpy(&packet[0], &accelerometerX, sizeof(accelerometerX));
-    memcpy(&packet[4], &accelerometerY, sizeof(accelerometerY));
-    memcpy(&packet[8], &accelerometerZ, sizeof(accelerometerZ));
+    history_position = (history_position + 1) % RWUG_MAX_HISTORY_LENGTH;
+    ++outgoing_sequence;
 
-    float gyroscopePitch = bswap32f(-pad->gyro.x * 360.0);
-    float gyroscopeYaw   = bswap32f(-pad->gyro.y * 360.0);
-    float gyroscopeRoll  = bswap32f( pad->gyro.z * 360.0);
+    return RWUG_EXTENSION_HEADER_SIZE + payload_length;
+}
+
+static void pack_floats(uint8_t* packet, const float* values, const uint8_t count) {
+    for (uint8_t i = 0; i < count; ++i) {
+        float value = bswap32f(values[i]);
+        memcpy(&packet[i * 4], &value, sizeof(value));
+    }
+}
+
+uint8_t pack_prediction_extension(VPADStatus* pad, uint8_t* extension, uint64_t* microseconds) {
+    prediction result;
+    update_prediction(pad, *microseconds, &result);
+
+    extension[0] = RWUG_EXTENSION_PREDICTION;
+    extension[1] = RWUG_PREDICTION_SIZE;
+
+    uint32_t latency = bswap32u(get_prediction_latency());
+    memcpy(&extension[2], &latency, sizeof(latency));
+
+    pack_floats(&extension[6],  result.orientation, 3);
+    pack_floats(&extension[18], result.predicted_orientation, 3);
+    pack_floats(&extension[30], result.predicted_sticks, 4);
+
+    return RWUG_EXTENSION_HEADER_SIZE + RWUG_PREDICTION_SIZE;
+}
+
+uint8_t pack_edges_extension(uint8_t* extension) {
+    extension[0] = RWUG_EXTENSION_EDGES;
+    extension[1] = RWUG_EDGES_SIZE;
+
+    uint32_t pressed = bswap32u(pending_pressed);
+    uint32_t released = bswap32u(pending_released);
+    memcpy(&extension[2], &pressed, sizeof(pressed));
+    memcpy(&extension[6], &released, sizeof(released));
+
+    uint8_t* counts = &extension[10];
+    memset(counts, 0, 10);
+    for (uint8_t button = 0; button < INPUT_COUNTED_BUTTONS; ++button) {
+        uint8_t count = pending_press_counts[button] < 15 ? pending_press_counts[button] : 15;
+        counts[button / 2] |= count << ((button & 1) * 4);
+    }
+
+    return RWUG_EXTENSION_HEADER_SIZE + RWUG_EDGES_SIZE;
+}
+
+void pack_gamepad_data(VPADStatus* pad, const uint32_t held_buttons, VPADTouchData* touchpad, uint8_t* packet, uint64_t* microseconds) {
+    converted_sample converted;
+    convert_sample(pad, &converted);
 
-    // Gyroscope data (4 bytes each).
-    memcpy(&packet[12], &gyroscopePitch, sizeof(gyroscopePitch));
-    memcpy(&packet[16], &gyroscopeYaw,   sizeof(gyroscopeYaw));
-    memcpy(&packet[20], &gyroscopeRoll,  sizeof(gyroscopeRoll));
+    // Accelerometer and gyroscope data (4 bytes each).
+    memcpy(&packet[0], converted.motion, sizeof(converted.motion));
 
     uint16_t touchpadX = bswap16u(touchpad->x);
     uint16_t touchpadY = bswap16u(touchpad->y);
@@ -43,51 +282,130 @@ void pack_gamepad_data(VPADStatus* pad, VPADTouchData* touchpad, uint8_t* packet
     // Motion data timestamp in microseconds (8 bytes).
     memcpy(&packet[30], &timestamp, sizeof(timestamp));
 
-    uint32_t hold = bswap32u(pad->hold);
+    uint32_t hold = bswap32u(held_buttons);
 
     // Held button bitfield (4 bytes).
     memcpy(&packet[38], &hold, sizeof(hold));
 
-    float stickLX = bswap32f(pad->leftStick.x);
-    float stickLY = bswap32f(pad->leftStick.y);
-    float stickRX = bswap32f(pad->rightStick.x);
-    float stickRY = bswap32f(pad->rightStick.y);
-
-    // Stick values (4 bytes).
-    memcpy(&packet[42], &stickLX, sizeof(stickLX));
-    memcpy(&packet[46], &stickLY, sizeof(stickLX));
-    memcpy(&packet[50], &stickRX, sizeof(stickLX));
-    memcpy(&packet[54], &stickRY, sizeof(stickLX));
-}
-
-void handle_force_feedback(int* socket) {
-    uint8_t incoming_packet[RWUG_IN_SIZE];
-    while (recv(*socket, incoming_packet, RWUG_IN_SIZE, MSG_DONTWAIT) > 0) {
-        if (incoming_packet[0] == RWUG_PLAY) {
-            uint16_t length;
-            memcpy(&length, &incoming_packet[2], sizeof(uint16_t));
-            length = bswap16u(length) * (120.0 / 1000.0); // uinput length in ms, VPAD length of 120 is about 1000ms
-
-            VPADStopMotor(VPAD_CHAN_0);
-
-            uint8_t pattern[120];
-            memset(&pattern[0], incoming_packet[1], 120); // incoming_packet[1] == strength
-
-            while (length > 0) {
-                uint8_t step = length < 120 ? length : 120;
-                VPADControlMotor(VPAD_CHAN_0, pattern, step);
-                length -= step;
-            }
-        } else if (incoming_packet[0] == RWUG_STOP) {
-            VPADStopMotor(VPAD_CHAN_0);
+    // Stick values (4 bytes each).
+    memcpy(&packet[42], converted.sticks, sizeof(converted.sticks));
+}
+
+uint16_t pack_audio_packet(uint8_t* packet, const uint32_t sequence, const uint64_t timestamp, const uint16_t sample_rate, const int16_t* samples, const uint16_t sample_count) {
+    memcpy(&packet[0], RWUG_AUDIO, 8);
+
+    uint32_t swapped_sequence = bswap32u(sequence);
+    uint64_t swapped_timestamp = bswap64u(timestamp);
+    uint16_t swapped_sample_rate = bswap16u(sample_rate);
+    uint16_t swapped_sample_count = bswap16u(sample_count);
+
+    memcpy(&packet[8],  &swapped_sequence,     sizeof(swapped_sequence));
+    memcpy(&packet[12], &swapped_timestamp,    sizeof(swapped_timestamp));
+    memcpy(&packet[20], &swapped_sample_rate,  sizeof(swapped_sample_rate));
+    memcpy(&packet[22], &swapped_sample_count, sizeof(swapped_sample_count));
+
+    for (uint16_t i = 0; i < sample_count; ++i) {
+        uint16_t sample = bswap16u((uint16_t) samples[i]);
+        memcpy(&packet[RWUG_AUDIO_HEADER_SIZE + i * 2], &sample, sizeof(sample));
+    }
+
+    return RWUG_AUDIO_HEADER_SIZE + sample_count * 2;
+}
+
+bool handle_force_feedback(const uint8_t* incoming_packet, ssize_t packet_length) {
+    if (packet_length != RWUG_IN_SIZE) return false;
+
+    if (incoming_packet[0] == RWUG_PLAY) {
+        uint16_t length;
+        memcpy(&length, &incoming_packet[2], sizeof(uint16_t));
+        record_flight_event(FLIGHT_EVENT_RUMBLE, bswap16u(length), RWUG_PLAY);
+        length = bswap16u(length) * (120.0 / 1000.0); // uinput length in ms, VPAD length of 120 is about 1000ms
+
+        VPADStopMotor(VPAD_CHAN_0);
+
+        uint8_t pattern[120];
+        memset(&pattern[0], incoming_packet[1], 120); // incoming_packet[1] == strength
+
+        while (length > 0) {
+            uint8_t step = length < 120 ? length : 120;
+            VPADControlMotor(VPAD_CHAN_0, pattern, step);
+            length -= step;
         }
+    } else if (incoming_packet[0] == RWUG_STOP) {
+        record_flight_event(FLIGHT_EVENT_RUMBLE, 0, RWUG_STOP);
+        VPADStopMotor(VPAD_CHAN_0);
+    } else {
+        return false;
     }
+
+    ++telemetry.rumble_commands;
+    return true;
 }
 
-void update_rwug(int* socket, VPADStatus* pad, VPADTouchData* touchpad, uint64_t* microseconds, const struct sockaddr* server_address, const socklen_t server_address_size) {
-    uint8_t outgoing_packet[RWUG_OUT_SIZE];
-    pack_gamepad_data(pad, touchpad, outgoing_packet, microseconds);
-    sendto(*socket, outgoing_packet, RWUG_OUT_SIZE, 0, server_address, server_address_size);
+void send_discovery_probe(int* socket, const uint16_t server_port) {
+    struct sockaddr_in broadcast_address;
+    memset(&broadcast_address, 0, sizeof(broadcast_address));
+
+    broadcast_address.sin_family = AF_INET;
+    broadcast_address.sin_port = htons(server_port);
+    broadcast_address.sin_addr.s_addr = htonl(INADDR_BROADCAST);
+
+    send_udp_socket(*socket, RWUG_DISCOVERY_PROBE, RWUG_DISCOVERY_SIZE, (const struct sockaddr*) &broadcast_address, sizeof(broadcast_address));
+}
+
+bool handle_discovery_reply(const uint8_t* incoming_packet, ssize_t packet_length) {
+    return packet_length == RWUG_DISCOVERY_SIZE && memcmp(incoming_packet, RWUG_DISCOVERY_REPLY, RWUG_DISCOVERY_SIZE) == 0;
+}
+
+void update_rwug(int* socket, input_state* input, VPADTouchData* touchpad, uint64_t* microseconds, const struct sockaddr* server_address, const socklen_t server_address_size) {
+    // Until the server acknowledged the hello, the legacy packet is sent.
+    if (requested_features != 0 && !acknowledged) {
+        const uint64_t interval = handshake_attempts < RWUG_HANDSHAKE_ATTEMPTS ? RWUG_HANDSHAKE_INTERVAL : RWUG_HANDSHAKE_RETRY_INTERVAL;
+        if (last_hello == 0 || *microseconds - last_hello >= interval) send_hello(socket, server_address, server_address_size, *microseconds);
+    }
+
+    pending_pressed  |= input->pressed;
+    pending_released |= input->released;
+    for (uint8_t button = 0; button < INPUT_COUNTED_BUTTONS; ++button) {
+        uint16_t count = pending_press_counts[button] + input->press_counts[button];
+        pending_press_counts[button] = count < 255 ? count : 255;
+    }
+
+    for (uint8_t i = 0; i < INPUT_MOTION_VALUES; ++i) pending_motion_sum[i] += input->motion_sum[i];
+    pending_motion_samples += input->motion_samples;
+
+    if (++rate_counter < rate_divider) return;
+    rate_counter = 0;
+
+    VPADStatus* pad = &input->pad;
+    uint32_t hold = pad->hold | pending_pressed;
+
+    VPADStatus averaged_pad;
+    if (rate_divider > 1 && pending_motion_samples > 0) {
+        averaged_pad = *pad;
+        average_motion(&averaged_pad, pending_motion_sum, pending_motion_samples);
+        pad = &averaged_pad;
+    }
+
+    uint8_t outgoing_packet[RWUG_MAX_OUT_SIZE];
+    pack_gamepad_data(pad, hold, touchpad, outgoing_packet, microseconds);
+
+    uint16_t packet_size = RWUG_OUT_SIZE;
+    if (enabled_features & RWUG_FEATURE_SEQUENCE)    packet_size += pack_sequence_extension(pad, hold, &outgoing_packet[packet_size]);
+    if (enabled_features & RWUG_FEATURE_ORIENTATION) packet_size += pack_prediction_extension(pad, &outgoing_packet[packet_size], microseconds);
+    if (enabled_features & RWUG_FEATURE_EDGES)       packet_size += pack_edges_extension(&outgoing_packet[packet_size]);
+
+    pending_pressed = 0;
+    pending_released = 0;
+    memset(pending_press_counts, 0, sizeof(pending_press_counts));
+    memset(pending_motion_sum, 0, sizeof(pending_motion_sum));
+    pending_motion_samples = 0;
+
+    ssize_t result = send_udp_socket(*socket, outgoing_packet, packet_size, server_address, server_address_size);
+    record_flight_event(FLIGHT_EVENT_RWUG_SEND, result, 0);
+
+    if (result < 0) ++telemetry.send_errors;
+    else ++telemetry.rwug_packets_sent;
+}
 
-    handle_force_feedback(socket);
-}
\ No newline at end of file
+#endif
@@ -1,4 +1,29 @@
 #include <vpad/input.h>
 #include <arpa/inet.h>
+#include <stdbool.h>
 
-void update_rwug(int* socket, VPADStatus* pad, VPADTouchData* touchpad, uint64_t* microseconds, const struct sockaddr* server_address, const socklen_t server_address_size);
\ No newline at end of file
+#include "input.h"
+
+// Features that client and server can agree on during the handshake.
+#define RWUG_FEATURE_COMPACT     0x01 // Reserved, not supported by this client.
+#define RWUG_FEATURE_BATCHING    0x02 // Reserved, not supported by this client.
+#define RWUG_FEATURE_SEQUENCE    0x04 // Sequence numbers and input history.
+#define RWUG_FEATURE_ORIENTATION 0x08 // Integrated and predicted orientation and predicted sticks.
+#define RWUG_FEATURE_TELEMETRY   0x10 // The server receives telemetry on its port.
+#define RWUG_FEATURE_EDGES       0x20 // Button presses and releases between packets.
+#define RWUG_FEATURE_AUDIO       0x40 // Microphone audio packets.
+
+// Largest audio packet, in bytes.
+#define RWUG_AUDIO_HEADER_SIZE 24
+#define RWUG_MAX_AUDIO_SIZE 512
+
+void configure_rwug(const uint8_t requested_history_length, const bool request_prediction, const bool request_edges, const bool request_audio, const bool request_telemetry, const uint16_t rate);
+void start_rwug_handshake();
+bool handle_handshake_ack(const uint8_t* incoming_packet, ssize_t packet_length, const uint64_t microseconds);
+uint32_t get_rwug_features();
+bool is_rwug_handshake_acknowledged();
+bool handle_force_feedback(const uint8_t* incoming_packet, ssize_t packet_length);
+void send_discovery_probe(int* socket, const uint16_t server_port);
+bool handle_discovery_reply(const uint8_t* incoming_packet, ssize_t packet_length);
+uint16_t pack_audio_packet(uint8_t* packet, const uint32_t sequence, const uint64_t timestamp, const uint16_t sample_rate, const int16_t* samples, const uint16_t sample_count);
+void update_rwug(int* socket, input_state* input, VPADTouchData* touchpad, uint64_t* microseconds, const struct sockaddr* server_address, const socklen_t server_address_size);
@@ -0,0 +1,83 @@
+#include "sample_conversion.h"
+
+#include <string.h>
+
+#include "byte_swap.h"
+
+#define VALUE_COUNT 10
+
+// Accelerometer, gyroscope (rotations per second to degrees per second) and sticks, in that order.
+// Negating and multiplying by 360 are exact or single rounded in both paths, so their results are bit-identical.
+// tools/benchmark checks this against the double precision formulas the encoders used before.
+static const float scales[VALUE_COUNT] __attribute__((aligned(8))) = {
+    -1.0f,    1.0f,    -1.0f,
+    -360.0f, -360.0f,  360.0f,
+    1.0f,     1.0f,     1.0f,    1.0f
+};
+
+#if defined(__WIIU__) && !defined(SCALAR_SAMPLE_CONVERSION)
+
+// Uses the paired-single unit of the Espresso to scale two values per instruction.
+// Relies on GQR0 being set up for unscaled floats, which is the case on Cafe OS.
+static void scale_values(const float* values, float* scaled) {
+    for (uint8_t i = 0; i < VALUE_COUNT; i += 2) {
+        double pair, scale;
+
+        __asm__ volatile (
+            "psq_l  %[pair], 0(%[values]), 0, 0\n\t"
+            "psq_l  %[scale], 0(%[scales]), 0, 0\n\t"
+            "ps_mul %[pair], %[pair], %[scale]\n\t"
+            "psq_st %[pair], 0(%[scaled]), 0, 0"
+            : [pair] "=&f" (pair), [scale] "=&f" (scale)
+            : [values] "b" (&values[i]), [scales] "b" (&scales[i]), [scaled] "b" (&scaled[i])
+            : "memory"
+        );
+    }
+}
+
+#else
+
+static void scale_values(const float* values, float* scaled) {
+    for (uint8_t i = 0; i < VALUE_COUNT; ++i) scaled[i] = values[i] * scales[i];
+}
+
+#endif
+
+void convert_sample(const VPADStatus* pad, converted_sample* converted) {
+    const float values[VALUE_COUNT] __attribute__((aligned(8))) = {
+        pad->accelorometer.acc.x, pad->accelorometer.acc.y, pad->accelorometer.acc.z,
+        pad->gyro.x, pad->gyro.y, pad->gyro.z,
+        pad->leftStick.x, pad->leftStick.y, pad->rightStick.x, pad->rightStick.y
+    };
+
+    float scaled[VALUE_COUNT] __attribute__((aligned(8)));
+    scale_values(values, scaled);
+
+    uint32_t bits[VALUE_COUNT];
+    memcpy(bits, scaled, sizeof(bits));
+
+    for (uint8_t i = 0; i < 6; ++i) converted->motion[i] = bswap32u(bits[i]);
+    for (uint8_t i = 0; i < 4; ++i) converted->sticks[i] = bswap32u(bits[6 + i]);
+}
+
+// Gyroscope rates with the axes and scaling of the packets, in degrees per second (pitch, yaw, roll).
+// Uses the same scales as convert_sample(), so the prediction integrates exactly what the packets report.
+void convert_gyro_rates(const VPADStatus* pad, float* rates) {
+    rates[0] = pad->gyro.x * scales[3];
+    rates[1] = pad->gyro.y * scales[4];
+    rates[2] = pad->gyro.z * scales[5];
+}
+
+// Replaces the accelerometer and gyroscope values with the average of motion_samples samples. The average gyroscope rate
+// times the interval is the same angle as the sum of every sample's rotation, so fast movements between two packets
+// aren't lost like when only the newest sample is sent.
+void average_motion(VPADStatus* pad, const float* motion_sum, const int32_t motion_samples) {
+    const float scale = 1.0f / motion_samples;
+
+    pad->accelorometer.acc.x = motion_sum[0] * scale;
+    pad->accelorometer.acc.y = motion_sum[1] * scale;
+    pad->accelorometer.acc.z = motion_sum[2] * scale;
+    pad->gyro.x = motion_sum[3] * scale;
+    pad->gyro.y = motion_sum[4] * scale;
+    pad->gyro.z = motion_sum[5] * scale;
+}
@@ -0,0 +1,14 @@
+#include <vpad/input.h>
+
+// Motion and stick values of a sample, scaled, in single precision and byte swapped for both DSU and RWUG packets.
+typedef struct {
+    // Accelerometer X, Y, Z and gyroscope pitch, yaw, roll in degrees per second.
+    uint32_t motion[6];
+
+    // Left stick X, Y and right stick X, Y.
+    uint32_t sticks[4];
+} converted_sample;
+
+void convert_sample(const VPADStatus* pad, converted_sample* converted);
+void convert_gyro_rates(const VPADStatus* pad, float* rates);
+void average_motion(VPADStatus* pad, const float* motion_sum, const int32_t motion_samples);
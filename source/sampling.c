@@ -0,0 +1,69 @@
+#include "sampling.h"
+
+#include <coreinit/event.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <vpad/input.h>
+#include <stddef.h>
+
+// Stack size of the sampling thread, in bytes.
+#define SAMPLING_STACK_SIZE 0x10000
+
+// Priority of the sampling thread. It runs before the main thread, which only does housekeeping in this mode.
+#define SAMPLING_THREAD_PRIORITY 15
+
+// The handler also runs if no sample arrives within this time, e.g. while the GamePad is disconnected, in microseconds.
+#define SAMPLING_TIMEOUT 100000
+
+static OSThread thread __attribute__((aligned(8)));
+static uint8_t stack[SAMPLING_STACK_SIZE] __attribute__((aligned(16)));
+
+static OSEvent sample_event;
+static volatile bool running = false;
+
+static sample_handler handler;
+static void* handler_context;
+
+// Runs in the context of VPAD, so it only wakes the sampling thread.
+static void sampling_callback(VPADChan chan) {
+    OSSignalEvent(&sample_event);
+}
+
+static int sampling_thread(int argc, const char** argv) {
+    while (running) {
+        OSWaitEventWithTimeout(&sample_event, OSMicrosecondsToTicks(SAMPLING_TIMEOUT));
+        if (running) handler(handler_context);
+    }
+
+    return 0;
+}
+
+// Calls the handler on a separate thread whenever VPAD received a new sample.
+bool start_sampling(sample_handler sample_handler, void* context) {
+    handler = sample_handler;
+    handler_context = context;
+    running = true;
+
+    OSInitEvent(&sample_event, false, OS_EVENT_MODE_AUTO);
+
+    if (!OSCreateThread(&thread, sampling_thread, 0, NULL, stack + SAMPLING_STACK_SIZE, SAMPLING_STACK_SIZE, SAMPLING_THREAD_PRIORITY, OS_THREAD_ATTRIB_AFFINITY_ANY)) {
+        running = false;
+        return false;
+    }
+
+    OSSetThreadName(&thread, "RWUG sampling");
+    OSResumeThread(&thread);
+
+    VPADSetSamplingCallback(VPAD_CHAN_0, sampling_callback);
+    return true;
+}
+
+void stop_sampling() {
+    if (!running) return;
+
+    VPADSetSamplingCallback(VPAD_CHAN_0, NULL);
+
+    running = false;
+    OSSignalEvent(&sample_event);
+    OSJoinThread(&thread, NULL);
+}
@@ -0,0 +1,6 @@
+#include <stdbool.h>
+
+typedef void (*sample_handler)(void* context);
+
+bool start_sampling(sample_handler handler, void* context);
+void stop_sampling();
@@ -0,0 +1,229 @@
+#include "streaming.h"
+
+#include <coreinit/time.h>
+#include <coreinit/mutex.h>
+#include <vpad/input.h>
+
+#include "udp_socket.h"
+#include "dsu.h"
+#include "rwug.h"
+#include "input.h"
+#include "power.h"
+#include "telemetry.h"
+#include "flight_recorder.h"
+
+// The send path of the client and the handling of incoming datagrams, without any of the startup, menu or SD card code
+// of main.c, so it can also be driven on a host (see tools/soak).
+
+// With the sampling callback, a sample is sent if the update is due within this time, in microseconds.
+// GamePad samples arrive about every 5 ms.
+#define SAMPLE_TOLERANCE 2500
+
+// A sample that is delayed by more than this is considered a hitch and dumps the flight recorder, in microseconds.
+// The dump is delayed to also capture what happens after the hitch and there is at most one dump per cooldown.
+#define HITCH_THRESHOLD 20000
+#define HITCH_DUMP_DELAY 1000000
+#define HITCH_DUMP_COOLDOWN 10000000
+
+// Holding ZL and ZR while pressing minus dumps the flight recorder.
+#define DUMP_COMBO (VPAD_BUTTON_ZL | VPAD_BUTTON_ZR)
+
+// Maximum amount of datagrams handled per wakeup, so a flood of requests can't delay the next sample.
+#define INCOMING_BATCH_SIZE 16
+
+// Time since the console started, which unlike the wall clock never jumps backwards. Timestamps of all packets,
+// timeouts and telemetry use it.
+uint64_t get_microseconds() {
+    return OSTicksToMicroseconds(OSGetSystemTime());
+}
+
+// DSU requests on the shared socket are answered by shared_dsu_server, which is NULL if DSU is disabled.
+static void handle_incoming_datagrams(int* socket, dsu_server* shared_dsu_server, const bool enable_rwug, const struct sockaddr_in* rwug_server_address, discovery_state* discovery) {
+    uint8_t incoming_packet[INCOMING_BUFFER_SIZE];
+    struct sockaddr_in sender;
+
+    for (uint8_t i = 0; i < INCOMING_BATCH_SIZE; ++i) {
+        socklen_t sender_size = sizeof(sender);
+
+        // This operation is non-blocking.
+        // length is < 0 once the receive queue has been drained.
+        ssize_t length = receive_udp_socket(*socket, incoming_packet, INCOMING_BUFFER_SIZE, (struct sockaddr*) &sender, &sender_size);
+        if (length < 0) break;
+
+        uint64_t microseconds = get_microseconds();
+
+#ifndef RWUG_ONLY
+        if (shared_dsu_server != NULL && handle_dsu_request(shared_dsu_server, incoming_packet, length, &sender, &microseconds)) {
+            wake_power(microseconds);
+            continue;
+        }
+#endif
+
+#ifndef DSU_ONLY
+#ifndef RWUG_ONLY
+        if (!enable_rwug) continue;
+#endif
+
+        if (handle_discovery_reply(incoming_packet, length)) {
+            if (!discovery->active) continue;
+
+            if (sender.sin_addr.s_addr == rwug_server_address->sin_addr.s_addr) discovery->active = false;
+            else if (discovery->candidate.s_addr == 0) discovery->candidate = sender.sin_addr;
+        } else if (sender.sin_addr.s_addr == rwug_server_address->sin_addr.s_addr) {
+            if (handle_handshake_ack(incoming_packet, length, microseconds) || handle_force_feedback(incoming_packet, length)) {
+                report_server_activity(microseconds);
+            }
+        }
+#endif
+    }
+}
+
+// Answers everything that arrived on the shared socket and on the sockets of further DSU servers.
+void receive_datagrams(send_state* state, discovery_state* discovery) {
+    OSLockMutex(&state->mutex);
+
+    dsu_server* shared_dsu_server = state->dsu_server_count > 0 && !state->dsu_servers[0].owns_socket ? &state->dsu_servers[0] : NULL;
+    handle_incoming_datagrams(state->socket, shared_dsu_server, state->enable_rwug, state->rwug_server_address, discovery);
+
+#ifndef RWUG_ONLY
+    // Servers with their own socket. Their receives never block, so servers without requests return right away.
+    uint64_t microseconds = get_microseconds();
+    for (uint8_t i = 0; i < state->dsu_server_count; ++i) {
+        if (receive_dsu_requests(&state->dsu_servers[i], &microseconds) > 0) wake_power(microseconds);
+    }
+#endif
+
+    OSUnlockMutex(&state->mutex);
+}
+
+// Ends the discovery once its deadline passed. Returns true if the saved server didn't answer in time and the first
+// other server that answered is used instead, which the caller should save.
+bool update_discovery(send_state* state, discovery_state* discovery) {
+#ifndef DSU_ONLY
+    if (!discovery->active || OSGetSystemTime() < discovery->deadline) return false;
+
+    discovery->active = false;
+    if (discovery->candidate.s_addr == 0) return false;
+
+    OSLockMutex(&state->mutex);
+    state->rwug_server_address->sin_addr = discovery->candidate;
+    start_rwug_handshake();
+    OSUnlockMutex(&state->mutex);
+
+    return true;
+#else
+    return false;
+#endif
+}
+
+// The RWUG-only client always sends to the RWUG server, so the send path doesn't check it at runtime.
+static inline bool is_rwug_enabled(const send_state* state) {
+#ifdef RWUG_ONLY
+    return true;
+#else
+    return state->enable_rwug;
+#endif
+}
+
+// Reads the newest input and sends it. delay is the time the sample is late, in microseconds.
+void send_sample(send_state* state, const OSTime now, const uint32_t delay) {
+    uint32_t loop_period = state->last_update != 0 ? OSTicksToMicroseconds(now - state->last_update) : 0;
+    record_loop_period(loop_period, state->power == POWER_IDLE);
+    record_flight_event(FLIGHT_EVENT_LOOP_START, loop_period, 0);
+    state->last_update = now;
+
+    if (delay > HITCH_THRESHOLD) {
+        record_flight_event(FLIGHT_EVENT_DEADLINE_OVERRUN, delay, 0);
+
+        if (state->hitch_dump_due == 0 && (state->last_hitch_dump == 0 || now - state->last_hitch_dump > OSMicrosecondsToTicks(HITCH_DUMP_COOLDOWN))) {
+            state->hitch_dump_due = now + OSMicrosecondsToTicks(HITCH_DUMP_DELAY);
+        }
+    }
+
+    input_state* input = &state->input;
+    read_input(input);
+    record_flight_event(FLIGHT_EVENT_VPAD_READ, input->sample_count, 0);
+    if (input->sample_count > 0) telemetry.samples_read += input->sample_count;
+
+    if ((input->pad.hold & DUMP_COMBO) == DUMP_COMBO && (input->pressed & VPAD_BUTTON_MINUS)) state->dump_requested = true;
+
+    VPADTouchData touchpad_data;
+    VPADGetTPCalibratedPointEx(VPAD_CHAN_0, VPAD_TP_854X480, &touchpad_data, &input->pad.tpNormal);
+
+    uint64_t microseconds = get_microseconds();
+
+    // Input edges end the idle state within one update. Legacy RWUG servers never send anything, so they always count
+    // as listening. Servers that acknowledged the handshake count as listening while they send.
+    bool has_listeners = telemetry.dsu_subscribers != 0;
+#ifndef DSU_ONLY
+    if (is_rwug_enabled(state) && !is_rwug_handshake_acknowledged()) has_listeners = true;
+#endif
+    state->power = update_power(input, has_listeners, microseconds);
+
+#ifndef DSU_ONLY
+    const struct sockaddr* rwug_server_address = (const struct sockaddr*) state->rwug_server_address;
+    if (is_rwug_enabled(state)) update_rwug(state->socket, input, &touchpad_data, &microseconds, rwug_server_address, state->rwug_server_address_size);
+#endif
+
+#ifndef RWUG_ONLY
+    uint8_t dsu_subscribers = 0;
+    for (uint8_t i = 0; i < state->dsu_server_count; ++i) {
+        dsu_subscribers += update_dsu(&state->dsu_servers[i], &microseconds, input, &touchpad_data);
+    }
+    telemetry.dsu_subscribers = dsu_subscribers;
+#endif
+
+    if (state->enable_telemetry) update_telemetry(state->socket, (const struct sockaddr*) state->telemetry_address, state->telemetry_address_size, microseconds, state->dsu_servers, state->dsu_server_count);
+#ifndef DSU_ONLY
+    else if (is_rwug_enabled(state) && (get_rwug_features() & RWUG_FEATURE_TELEMETRY)) update_telemetry(state->socket, rwug_server_address, state->rwug_server_address_size, microseconds, state->dsu_servers, state->dsu_server_count);
+#endif
+}
+
+// Called by the sampling thread for every new GamePad sample. Samples arrive faster than they are sent,
+// so a sample is sent if the update is due within half a sample period.
+void send_sampled(void* context) {
+    send_state* state = (send_state*) context;
+    const OSTime now = OSGetSystemTime();
+
+    OSLockMutex(&state->mutex);
+
+    const OSTime interval = OSMicrosecondsToTicks(state->power == POWER_IDLE ? IDLE_UPDATE_RATE : state->update_rate);
+    const OSTime elapsed = now - state->last_update;
+    if (state->last_update == 0 || get_power_state() != state->power || elapsed + OSMicrosecondsToTicks(SAMPLE_TOLERANCE) >= interval) {
+        send_sample(state, now, elapsed > interval && state->last_update != 0 ? OSTicksToMicroseconds(elapsed - interval) : 0);
+    }
+
+    OSUnlockMutex(&state->mutex);
+}
+
+// Sends the sample that is due at the given time and returns when the next one is due. Missed samples are skipped
+// instead of sending a burst to catch up.
+OSTime send_scheduled(send_state* state, const OSTime due, const OSTime now) {
+    const OSTime update_interval = OSMicrosecondsToTicks(state->power == POWER_IDLE ? IDLE_UPDATE_RATE : state->update_rate);
+    OSTime next_update = due + update_interval;
+    if (next_update < now) next_update = now + update_interval;
+
+    power_state previous_power = state->power;
+    send_sample(state, now, now > due ? OSTicksToMicroseconds(now - due) : 0);
+
+    if (state->power != previous_power) {
+        next_update = now + OSMicrosecondsToTicks(state->power == POWER_IDLE ? IDLE_UPDATE_RATE : state->update_rate);
+    }
+
+    return next_update;
+}
+
+// The events are copied right away and written to the SD card by a low priority thread, so dumps don't delay samples.
+// A dump that is due while the previous one is still being written is retried on the next call.
+void write_flight_recorder_dumps(send_state* state) {
+    OSLockMutex(&state->mutex);
+
+    const bool dump_due = state->dump_requested || (state->hitch_dump_due != 0 && OSGetSystemTime() >= state->hitch_dump_due);
+    if (dump_due && dump_flight_recorder()) {
+        state->dump_requested = false;
+        state->hitch_dump_due = 0;
+        state->last_hitch_dump = OSGetSystemTime();
+    }
+
+    OSUnlockMutex(&state->mutex);
+}
@@ -0,0 +1,60 @@
+#include <coreinit/time.h>
+#include <coreinit/mutex.h>
+#include <arpa/inet.h>
+#include <stdbool.h>
+
+#include "dsu.h"
+#include "input.h"
+#include "power.h"
+
+// Update interval while idle, in microseconds. RWUG packets are sent at this rate as a heartbeat.
+// It stays below the 80 ms of samples VPAD buffers, so a press while idle is always read and ends the idle state.
+#define IDLE_UPDATE_RATE 50000
+
+// Incoming datagrams are at most a DSU request (28 bytes) or a force feedback command (4 bytes).
+#define INCOMING_BUFFER_SIZE 32
+
+// The startup discovery keeps the saved RWUG server if it answers before the deadline. Otherwise, the first other
+// server that answered replaces it. candidate is 0 until another server answered.
+typedef struct {
+    bool active;
+    OSTime deadline;
+    struct in_addr candidate;
+} discovery_state;
+
+// State of the send path. With the sampling callback, it's used by the sampling thread while the main thread
+// handles incoming datagrams, so both hold the mutex.
+typedef struct {
+    int* socket;
+    bool enable_rwug;
+    dsu_server* dsu_servers;
+    uint8_t dsu_server_count;
+    bool enable_telemetry;
+    struct sockaddr_in* rwug_server_address;
+    socklen_t rwug_server_address_size;
+    struct sockaddr_in* telemetry_address;
+    socklen_t telemetry_address_size;
+
+    input_state input;
+    power_state power;
+    uint32_t update_rate;
+    OSTime last_update;
+
+    // The send path only requests flight recorder dumps, write_flight_recorder_dumps() on the main loop writes them.
+    OSTime hitch_dump_due;
+    OSTime last_hitch_dump;
+    bool dump_requested;
+
+    OSMutex mutex;
+} send_state;
+
+uint64_t get_microseconds();
+
+void receive_datagrams(send_state* state, discovery_state* discovery);
+bool update_discovery(send_state* state, discovery_state* discovery);
+
+void send_sample(send_state* state, const OSTime now, const uint32_t delay);
+void send_sampled(void* context);
+OSTime send_scheduled(send_state* state, const OSTime due, const OSTime now);
+
+void write_flight_recorder_dumps(send_state* state);
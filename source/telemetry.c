@@ -0,0 +1,118 @@
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "udp_socket.h"
+
+#ifdef __WIIU__
+#include <coreinit/memheap.h>
+#include <coreinit/memexpheap.h>
+#endif
+
+// Time between two published telemetry datagrams, in microseconds.
+#define PUBLISH_INTERVAL 1000000
+
+// Loop periods are sorted into buckets of BUCKET_WIDTH microseconds. The last bucket collects everything above.
+#define BUCKET_WIDTH 250
+#define BUCKET_COUNT 64
+
+#define OUTGOING_BUFFER_SIZE 512
+
+telemetry_counters telemetry;
+
+static uint32_t loop_period_buckets[BUCKET_COUNT];
+static uint32_t loop_period_count;
+static uint32_t loop_period_max;
+
+// Whether any loop period of the interval was at the idle rate, so collectors can tell it from a slow loop.
+static bool loop_idle;
+
+static uint64_t start_time;
+static uint64_t last_published;
+
+void record_loop_period(const uint32_t microseconds, const bool idle) {
+    if (idle) loop_idle = true;
+
+    uint32_t bucket = microseconds / BUCKET_WIDTH;
+    ++loop_period_buckets[bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1];
+    ++loop_period_count;
+
+    if (microseconds > loop_period_max) loop_period_max = microseconds;
+}
+
+// Returns the upper bound of the bucket that contains the given percentile, in microseconds.
+static uint32_t get_loop_period_percentile(const uint32_t percentile) {
+    uint32_t threshold = (loop_period_count * percentile + 99) / 100;
+    uint32_t count = 0;
+
+    for (uint32_t bucket = 0; bucket < BUCKET_COUNT - 1; ++bucket) {
+        count += loop_period_buckets[bucket];
+        if (count >= threshold) return (bucket + 1) * BUCKET_WIDTH;
+    }
+
+    return loop_period_max;
+}
+
+// Publishes the counters in a line protocol (one "key=value" pair per field), which tools/telemetry_collector.py understands.
+// Counters are totals since startup, loop periods and idle only cover the last interval. Every DSU server adds its own counters.
+void update_telemetry(int* socket, const struct sockaddr* collector_address, const socklen_t collector_address_size, const uint64_t microseconds, const dsu_server* dsu_servers, const uint8_t dsu_server_count) {
+    if (start_time == 0) start_time = last_published = microseconds;
+    if (microseconds - last_published < PUBLISH_INTERVAL) return;
+
+    last_published = microseconds;
+
+    // DSU servers only count into their own statistics, so they don't share any counters.
+    uint32_t dsu_packets_sent = 0, dsu_send_errors = 0;
+    for (uint8_t i = 0; i < dsu_server_count; ++i) {
+        dsu_packets_sent += dsu_servers[i].statistics.packets_sent;
+        dsu_send_errors += dsu_servers[i].statistics.send_errors;
+    }
+
+    char outgoing_packet[OUTGOING_BUFFER_SIZE];
+    int length = snprintf(outgoing_packet, OUTGOING_BUFFER_SIZE,
+        "rwug uptime=%llu samples=%lu rwug_sent=%lu dsu_sent=%lu send_errors=%lu dsu_subscribers=%u rumble=%lu audio_sent=%lu loop_p50=%lu loop_p90=%lu loop_p99=%lu loop_max=%lu idle=%u",
+        (unsigned long long) ((microseconds - start_time) / 1000000),
+        (unsigned long) telemetry.samples_read,
+        (unsigned long) telemetry.rwug_packets_sent,
+        (unsigned long) dsu_packets_sent,
+        (unsigned long) (telemetry.send_errors + dsu_send_errors),
+        (unsigned int) telemetry.dsu_subscribers,
+        (unsigned long) telemetry.rumble_commands,
+        (unsigned long) telemetry.audio_packets_sent,
+        (unsigned long) get_loop_period_percentile(50),
+        (unsigned long) get_loop_period_percentile(90),
+        (unsigned long) get_loop_period_percentile(99),
+        (unsigned long) loop_period_max,
+        (unsigned int) loop_idle
+    );
+
+#ifdef __WIIU__
+    // Free memory of the heap malloc() allocates from. If it shrinks over hours, something leaks.
+    if (length > 0 && length < OUTGOING_BUFFER_SIZE) {
+        length += snprintf(&outgoing_packet[length], OUTGOING_BUFFER_SIZE - length, " heap_free=%lu",
+            (unsigned long) MEMGetTotalFreeSizeForExpHeap(MEMGetBaseHeapHandle(MEM_BASE_HEAP_MEM2))
+        );
+    }
+#endif
+
+    for (uint8_t i = 0; i < dsu_server_count && length > 0 && length < OUTGOING_BUFFER_SIZE; ++i) {
+        const dsu_server* server = &dsu_servers[i];
+        length += snprintf(&outgoing_packet[length], OUTGOING_BUFFER_SIZE - length, " dsu%u_requests=%lu dsu%u_sent=%lu dsu%u_errors=%lu",
+            (unsigned int) server->port, (unsigned long) server->statistics.requests,
+            (unsigned int) server->port, (unsigned long) server->statistics.packets_sent,
+            (unsigned int) server->port, (unsigned long) server->statistics.send_errors
+        );
+    }
+
+    if (length > 0 && length < OUTGOING_BUFFER_SIZE) length += snprintf(&outgoing_packet[length], OUTGOING_BUFFER_SIZE - length, "\n");
+
+    memset(loop_period_buckets, 0, sizeof(loop_period_buckets));
+    loop_period_count = 0;
+    loop_period_max = 0;
+    loop_idle = false;
+
+    if (length > 0 && length < OUTGOING_BUFFER_SIZE) {
+        send_udp_socket(*socket, outgoing_packet, length, collector_address, collector_address_size);
+    }
+}
@@ -0,0 +1,19 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#include "dsu.h"
+
+typedef struct {
+    uint32_t samples_read;
+    uint32_t rwug_packets_sent;
+    uint32_t send_errors;
+    uint32_t rumble_commands;
+    uint32_t audio_packets_sent;
+    uint8_t dsu_subscribers;
+} telemetry_counters;
+
+extern telemetry_counters telemetry;
+
+void record_loop_period(const uint32_t microseconds, const bool idle);
+void update_telemetry(int* socket, const struct sockaddr* collector_address, const socklen_t collector_address_size, const uint64_t microseconds, const dsu_server* dsu_servers, const uint8_t dsu_server_count);
@@ -0,0 +1,120 @@
+#include "text_ui.h"
+
+#include <coreinit/screen.h>
+#include <coreinit/cache.h>
+#include <coreinit/thread.h>
+#include <coreinit/time.h>
+#include <malloc.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Duration of a single frame at 59.94 Hz, in microseconds.
+#define FRAME_DURATION 16683
+
+// Layout of the GamePad buffer: two halves with a pitch of 896 pixels (4 bytes each) and text rows of 24 pixels.
+// OSScreen draws into the half that isn't shown.
+#define DRC_PITCH (896 * 4)
+#define DRC_ROW_HEIGHT 24
+
+// The text is kept in a line cache per buffer half, so only the lines that changed since the half was last drawn are
+// cleared, redrawn and flushed. The TV buffer is cleared once and never touched again.
+static char pending_lines[TEXT_UI_ROWS][TEXT_UI_COLUMNS + 1];
+static char shown_lines[2][TEXT_UI_ROWS][TEXT_UI_COLUMNS + 1];
+static uint8_t back_buffer;
+
+static void* screen_buffer_tv;
+static void* screen_buffer_drc;
+static uint32_t screen_buffer_size_tv;
+static uint32_t screen_buffer_size_drc;
+
+static OSTime next_frame;
+
+void init_text_ui() {
+    OSScreenInit();
+
+    screen_buffer_size_tv = OSScreenGetBufferSizeEx(SCREEN_TV);
+    screen_buffer_size_drc = OSScreenGetBufferSizeEx(SCREEN_DRC);
+    screen_buffer_tv = memalign(0x100, screen_buffer_size_tv);
+    screen_buffer_drc = memalign(0x100, screen_buffer_size_drc);
+
+    OSScreenSetBufferEx(SCREEN_TV, screen_buffer_tv);
+    OSScreenSetBufferEx(SCREEN_DRC, screen_buffer_drc);
+    OSScreenEnableEx(SCREEN_TV, 1);
+    OSScreenEnableEx(SCREEN_DRC, 1);
+
+    // Both halves of the double buffered screens have to be cleared, then the line caches match them.
+    for (uint8_t i = 0; i < 2; ++i) {
+        OSScreenClearBufferEx(SCREEN_TV, 0x00000000);
+        OSScreenClearBufferEx(SCREEN_DRC, 0x00000000);
+        DCFlushRange(screen_buffer_tv, screen_buffer_size_tv);
+        DCFlushRange(screen_buffer_drc, screen_buffer_size_drc);
+        OSScreenFlipBuffersEx(SCREEN_TV);
+        OSScreenFlipBuffersEx(SCREEN_DRC);
+    }
+
+    memset(shown_lines, 0, sizeof(shown_lines));
+    back_buffer = 0;
+    clear_text_ui();
+
+    next_frame = OSGetSystemTime();
+}
+
+void destroy_text_ui() {
+    OSScreenShutdown();
+    free(screen_buffer_tv);
+    free(screen_buffer_drc);
+}
+
+void clear_text_ui() {
+    memset(pending_lines, 0, sizeof(pending_lines));
+}
+
+void print_text_ui(const uint8_t column, const uint8_t row, const char* text) {
+    if (row >= TEXT_UI_ROWS || column >= TEXT_UI_COLUMNS) return;
+
+    char* line = pending_lines[row];
+
+    // Pad the line with spaces up to the requested column.
+    size_t line_length = strlen(line);
+    if (line_length < column) {
+        memset(&line[line_length], ' ', column - line_length);
+    }
+
+    size_t text_length = strnlen(text, TEXT_UI_COLUMNS - column);
+    memcpy(&line[column], text, text_length);
+    if (column + text_length > line_length) line[column + text_length] = '\0';
+}
+
+// After a change, the other half still shows the previous text, so the next call redraws the same lines there.
+void present_text_ui() {
+    char (*shown)[TEXT_UI_COLUMNS + 1] = shown_lines[back_buffer];
+    if (memcmp(pending_lines, shown, sizeof(pending_lines)) == 0) return;
+
+    uint8_t* half = (uint8_t*) screen_buffer_drc + back_buffer * (screen_buffer_size_drc / 2);
+    int first_row = -1, last_row = -1;
+
+    for (uint8_t row = 0; row < TEXT_UI_ROWS; ++row) {
+        if (memcmp(pending_lines[row], shown[row], sizeof(shown[row])) == 0) continue;
+
+        memset(&half[row * DRC_ROW_HEIGHT * DRC_PITCH], 0, DRC_ROW_HEIGHT * DRC_PITCH);
+        if (pending_lines[row][0] != '\0') OSScreenPutFontEx(SCREEN_DRC, 0, row, pending_lines[row]);
+        memcpy(shown[row], pending_lines[row], sizeof(shown[row]));
+
+        if (first_row < 0) first_row = row;
+        last_row = row;
+    }
+
+    DCFlushRange(&half[first_row * DRC_ROW_HEIGHT * DRC_PITCH], (last_row - first_row + 1) * DRC_ROW_HEIGHT * DRC_PITCH);
+    OSScreenFlipBuffersEx(SCREEN_DRC);
+    back_buffer ^= 1;
+}
+
+void wait_text_ui_frame() {
+    const OSTime frame_duration = OSMicrosecondsToTicks(FRAME_DURATION);
+
+    next_frame += frame_duration;
+
+    OSTime now = OSGetSystemTime();
+    if (next_frame > now) OSSleepTicks(next_frame - now);
+    else next_frame = now;
+}
@@ -0,0 +1,13 @@
+#include <stdint.h>
+
+// Amount of text rows and columns that fit on the GamePad screen.
+#define TEXT_UI_ROWS 18
+#define TEXT_UI_COLUMNS 68
+
+void init_text_ui();
+void destroy_text_ui();
+
+void clear_text_ui();
+void print_text_ui(const uint8_t column, const uint8_t row, const char* text);
+void present_text_ui();
+void wait_text_ui_frame();
@@ -2,11 +2,20 @@
 
 #include <arpa/inet.h>
 #include <string.h>
+#include <sys/select.h>
+
+#ifdef NETWORK_IMPAIRMENT
+#include "impairment.h"
+#endif
 
 int init_udp_socket(const uint16_t bind_port) {
     int udp_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
     if (udp_socket < 0) return -1;
 
+    // Required to broadcast RWUG server discovery probes.
+    int broadcast = 1;
+    setsockopt(udp_socket, SOL_SOCKET, SO_BROADCAST, &broadcast, sizeof(broadcast));
+
     struct sockaddr_in bind_addr;
     memset(&bind_addr, 0, sizeof(bind_addr));
 
@@ -22,6 +31,53 @@ int init_udp_socket(const uint16_t bind_port) {
     return udp_socket;
 }
 
+// Blocks until a datagram can be read from any of the sockets or the timeout has passed.
+// Returns > 0 if a socket is readable, 0 on timeout and < 0 on error.
+// With NETWORK_IMPAIRMENT, it also returns > 0 once a delayed datagram is due, so it's handled by the next receive.
+int wait_udp_sockets(const int* udp_sockets, const uint8_t count, const uint32_t timeout_us) {
+    fd_set read_set;
+    FD_ZERO(&read_set);
+
+    int highest = -1;
+    for (uint8_t i = 0; i < count; ++i) {
+        FD_SET(udp_sockets[i], &read_set);
+        if (udp_sockets[i] > highest) highest = udp_sockets[i];
+    }
+
+#ifdef NETWORK_IMPAIRMENT
+    uint32_t impairment_timeout_us = timeout_us;
+    for (uint8_t i = 0; i < count; ++i) impairment_timeout_us = get_impairment_timeout(udp_sockets[i], impairment_timeout_us);
+    struct timeval timeout = { impairment_timeout_us / 1000000, impairment_timeout_us % 1000000 };
+
+    int readable = select(highest + 1, &read_set, NULL, NULL, &timeout);
+    return readable == 0 && impairment_timeout_us < timeout_us ? 1 : readable;
+#else
+    struct timeval timeout = { timeout_us / 1000000, timeout_us % 1000000 };
+    return select(highest + 1, &read_set, NULL, NULL, &timeout);
+#endif
+}
+
+int wait_udp_socket(const int udp_socket, const uint32_t timeout_us) {
+    return wait_udp_sockets(&udp_socket, 1, timeout_us);
+}
+
+ssize_t send_udp_socket(const int udp_socket, const void* data, const size_t length, const struct sockaddr* address, const socklen_t address_size) {
+#ifdef NETWORK_IMPAIRMENT
+    return impaired_send(udp_socket, data, length, address, address_size);
+#else
+    return sendto(udp_socket, data, length, 0, address, address_size);
+#endif
+}
+
+// Never blocks. Returns < 0 once the receive queue has been drained.
+ssize_t receive_udp_socket(const int udp_socket, void* buffer, const size_t size, struct sockaddr* sender, socklen_t* sender_size) {
+#ifdef NETWORK_IMPAIRMENT
+    return impaired_receive(udp_socket, buffer, size, sender, sender_size);
+#else
+    return recvfrom(udp_socket, buffer, size, MSG_DONTWAIT, sender, sender_size);
+#endif
+}
+
 void destroy_udp_socket(int* udp_socket) {
     if (*udp_socket >= 0) {
         close(*udp_socket);
@@ -1,4 +1,10 @@
 #include <unistd.h>
+#include <stdint.h>
+#include <sys/socket.h>
 
 int init_udp_socket(const uint16_t bind_port);
+int wait_udp_socket(const int udp_socket, const uint32_t timeout_us);
+int wait_udp_sockets(const int* udp_sockets, const uint8_t count, const uint32_t timeout_us);
+ssize_t send_udp_socket(const int udp_socket, const void* data, const size_t length, const struct sockaddr* address, const socklen_t address_size);
+ssize_t receive_udp_socket(const int udp_socket, void* buffer, const size_t size, struct sockaddr* sender, socklen_t* sender_size);
 void destroy_udp_socket(int* udp_socket);
@@ -0,0 +1,369 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vpad/input.h>
+#include <arpa/inet.h>
+
+#include "byte_swap.h"
+#include "flight_recorder.h"
+#include "sample_conversion.h"
+#include "remap.h"
+#include "udp_socket.h"
+#include "impairment.h"
+#include "microphone.h"
+#include "rwug.h"
+#include "dsu.h"
+
+// Encoders of dsu.c and rwug.c, which aren't exposed in their headers.
+void set_packet_header(uint8_t* packet, uint8_t packet_length, const uint32_t server_id);
+uint8_t pack_controller_data(uint8_t* packet, const uint32_t server_id, uint32_t packet_count, uint64_t timestamp, const uint32_t* motion, uint8_t touchpadActive, uint16_t touchpadX, uint16_t touchpadY, uint32_t hold, VPADStatus* pad);
+void pack_gamepad_data(VPADStatus* pad, const uint32_t held_buttons, VPADTouchData* touchpad, uint8_t* packet, uint64_t* microseconds);
+
+// Amount of randomized samples the benchmarks cycle through. Must be a power of two.
+#define SAMPLE_COUNT 1024
+
+#define WARMUP_ITERATIONS 100000
+#define ITERATIONS 1000000
+#define REPETITIONS 7
+
+// Loopback port of the impairment scenarios.
+#define IMPAIRMENT_PORT 4299
+
+static VPADStatus pads[SAMPLE_COUNT];
+static VPADTouchData touchpads[SAMPLE_COUNT];
+static float floats[SAMPLE_COUNT];
+static double doubles[SAMPLE_COUNT];
+
+// Keeps the compiler from optimizing the benchmarked work away.
+static volatile uint32_t sink;
+
+// The benchmarked implementations don't record anything.
+void record_flight_event(const flight_event_type type, const uint32_t argument, const uint16_t detail) {}
+void VPADStopMotor(VPADChan chan) {}
+int32_t VPADControlMotor(VPADChan chan, uint8_t* pattern, uint8_t length) { return 0; }
+
+static float random_float(float min, float max) {
+    return min + (max - min) * ((float) rand() / (float) RAND_MAX);
+}
+
+static void generate_samples() {
+    srand(4242);
+
+    for (uint32_t i = 0; i < SAMPLE_COUNT; ++i) {
+        VPADStatus* pad = &pads[i];
+        memset(pad, 0, sizeof(*pad));
+
+        // Mostly a few buttons at once, like during actual play.
+        pad->hold = (rand() & rand() & rand()) & 0x0007FFFF;
+
+        pad->leftStick.x  = random_float(-1.0f, 1.0f);
+        pad->leftStick.y  = random_float(-1.0f, 1.0f);
+        pad->rightStick.x = random_float(-1.0f, 1.0f);
+        pad->rightStick.y = random_float(-1.0f, 1.0f);
+
+        pad->accelorometer.acc.x = random_float(-2.0f, 2.0f);
+        pad->accelorometer.acc.y = random_float(-2.0f, 2.0f);
+        pad->accelorometer.acc.z = random_float(-2.0f, 2.0f);
+
+        pad->gyro.x = random_float(-1.5f, 1.5f);
+        pad->gyro.y = random_float(-1.5f, 1.5f);
+        pad->gyro.z = random_float(-1.5f, 1.5f);
+
+        touchpads[i].touched = rand() & 1;
+        touchpads[i].x = rand() % 854;
+        touchpads[i].y = rand() % 480;
+
+        floats[i] = random_float(-1000.0f, 1000.0f);
+        doubles[i] = random_float(-1000.0f, 1000.0f);
+    }
+
+    // Edge cases of the conversion: zero, subnormal, the largest float and a rate whose scaled value overflows.
+    const float edges[4] = { 0.0f, 1e-40f, 3.4028235e38f, 1e37f };
+    for (uint32_t i = 0; i < 4; ++i) {
+        pads[i].accelorometer.acc.x = pads[i].gyro.x = pads[i].leftStick.x = edges[i];
+        pads[i].accelorometer.acc.z = pads[i].gyro.z = pads[i].rightStick.y = -edges[i];
+    }
+}
+
+// Byte swapped bits of a float, like the encoders wrote them before convert_sample().
+static uint32_t swapped_bits(const float x) {
+    float swapped = bswap32f(x);
+
+    uint32_t bits;
+    memcpy(&bits, &swapped, sizeof(bits));
+    return bits;
+}
+
+// Compares convert_sample() bit for bit with the double precision formulas of the encoders it replaced.
+// Returns the amount of samples that differ.
+static uint32_t check_sample_conversion() {
+    uint32_t mismatches = 0;
+
+    for (uint32_t i = 0; i < SAMPLE_COUNT; ++i) {
+        const VPADStatus* pad = &pads[i];
+
+        const uint32_t expected[10] = {
+            swapped_bits(-pad->accelorometer.acc.x),
+            swapped_bits( pad->accelorometer.acc.y),
+            swapped_bits(-pad->accelorometer.acc.z),
+            swapped_bits(-pad->gyro.x * 360.0),
+            swapped_bits(-pad->gyro.y * 360.0),
+            swapped_bits( pad->gyro.z * 360.0),
+            swapped_bits(pad->leftStick.x),
+            swapped_bits(pad->leftStick.y),
+            swapped_bits(pad->rightStick.x),
+            swapped_bits(pad->rightStick.y)
+        };
+
+        converted_sample converted;
+        convert_sample(pad, &converted);
+
+        float rates[3];
+        convert_gyro_rates(pad, rates);
+
+        bool equal = memcmp(converted.motion, expected, sizeof(converted.motion)) == 0
+            && memcmp(converted.sticks, &expected[6], sizeof(converted.sticks)) == 0;
+        for (uint8_t axis = 0; axis < 3; ++axis) equal = equal && swapped_bits(rates[axis]) == expected[3 + axis];
+
+        if (!equal) ++mismatches;
+    }
+
+    return mismatches;
+}
+
+static uint64_t get_nanoseconds() {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+typedef uint32_t (*benchmark_function)(uint32_t iteration);
+
+static int compare_doubles(const void* a, const void* b) {
+    double difference = *(const double*) a - *(const double*) b;
+    return (difference > 0) - (difference < 0);
+}
+
+// Prints the median and fastest time per operation of all repetitions, and the throughput of the median.
+static void run_benchmark(const char* name, benchmark_function function, uint32_t bytes_per_op) {
+    uint32_t result = 0;
+
+    for (uint32_t i = 0; i < WARMUP_ITERATIONS; ++i) result += function(i);
+
+    double nanoseconds_per_op[REPETITIONS];
+    for (uint32_t repetition = 0; repetition < REPETITIONS; ++repetition) {
+        uint64_t start = get_nanoseconds();
+        for (uint32_t i = 0; i < ITERATIONS; ++i) result += function(i);
+        nanoseconds_per_op[repetition] = (double) (get_nanoseconds() - start) / ITERATIONS;
+    }
+
+    sink = result;
+
+    qsort(nanoseconds_per_op, REPETITIONS, sizeof(double), compare_doubles);
+    double median = nanoseconds_per_op[REPETITIONS / 2];
+
+    printf("%-24s %9.2f ns/op (min %9.2f) %12.0f op/s %9.1f MB/s\n",
+        name, median, nanoseconds_per_op[0], 1e9 / median, bytes_per_op * 1e3 / median);
+}
+
+static uint32_t benchmark_pack_controller_data(uint32_t iteration) {
+    VPADStatus* pad = &pads[iteration & (SAMPLE_COUNT - 1)];
+    VPADTouchData* touchpad = &touchpads[iteration & (SAMPLE_COUNT - 1)];
+
+    uint8_t packet[100];
+    converted_sample converted;
+    convert_sample(pad, &converted);
+
+    pack_controller_data(
+        packet, DSU_DEFAULT_SERVER_ID, bswap32u(iteration), bswap64u((uint64_t) iteration * 10000),
+        converted.motion,
+        touchpad->touched, bswap16u(touchpad->x), bswap16u(touchpad->y),
+        pad->hold, pad
+    );
+
+    return packet[8] ^ packet[36] ^ packet[99];
+}
+
+static uint32_t benchmark_set_packet_header(uint32_t iteration) {
+    uint8_t packet[100];
+    memcpy(&packet[16], &pads[iteration & (SAMPLE_COUNT - 1)], 84);
+
+    set_packet_header(packet, 100, DSU_DEFAULT_SERVER_ID);
+    return packet[8];
+}
+
+static uint32_t benchmark_pack_gamepad_data(uint32_t iteration) {
+    uint8_t packet[58];
+    uint64_t microseconds = (uint64_t) iteration * 10000;
+
+    pack_gamepad_data(&pads[iteration & (SAMPLE_COUNT - 1)], pads[iteration & (SAMPLE_COUNT - 1)].hold, &touchpads[iteration & (SAMPLE_COUNT - 1)], packet, &microseconds);
+    return packet[0] ^ packet[38] ^ packet[57];
+}
+
+static uint32_t benchmark_convert_sample(uint32_t iteration) {
+    converted_sample converted;
+    convert_sample(&pads[iteration & (SAMPLE_COUNT - 1)], &converted);
+
+    return converted.motion[0] ^ converted.motion[5] ^ converted.sticks[3];
+}
+
+static uint32_t benchmark_remap(uint32_t iteration) {
+    VPADStatus pad = pads[iteration & (SAMPLE_COUNT - 1)];
+    remap_buttons(&pad);
+    remap_sticks(&pad);
+
+    uint32_t bits;
+    memcpy(&bits, &pad.rightStick.y, sizeof(bits));
+    return pad.hold ^ bits;
+}
+
+static uint32_t benchmark_pack_audio_packet(uint32_t iteration) {
+    // 5 ms of audio, like the client sends.
+    static int16_t samples[MICROPHONE_SAMPLE_RATE / 200];
+    samples[iteration % (MICROPHONE_SAMPLE_RATE / 200)] = (int16_t) iteration;
+
+    uint8_t packet[RWUG_MAX_AUDIO_SIZE];
+    uint16_t size = pack_audio_packet(packet, iteration, (uint64_t) iteration * 5000, MICROPHONE_SAMPLE_RATE, samples, MICROPHONE_SAMPLE_RATE / 200);
+
+    return packet[8] ^ packet[size - 1];
+}
+
+static uint32_t benchmark_bswap32f(uint32_t iteration) {
+    float swapped = bswap32f(floats[iteration & (SAMPLE_COUNT - 1)]);
+
+    uint32_t bits;
+    memcpy(&bits, &swapped, sizeof(bits));
+    return bits;
+}
+
+static uint32_t benchmark_bswap64f(uint32_t iteration) {
+    double swapped = bswap64f(doubles[iteration & (SAMPLE_COUNT - 1)]);
+
+    uint64_t bits;
+    memcpy(&bits, &swapped, sizeof(bits));
+    return (uint32_t) bits;
+}
+
+// Reads 5 ms frames from the stand-in microphone for a second, like the audio thread does, and checks their timing.
+static void run_microphone_scenario() {
+    if (!open_microphone()) {
+        printf("%-24s could not open the stand-in microphone\n", "microphone");
+        return;
+    }
+
+    int16_t frame[MICROPHONE_SAMPLE_RATE / 200];
+    uint32_t frames = 0, max_age = 0;
+
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        struct timespec period = { 0, 5000000 };
+        nanosleep(&period, NULL);
+
+        uint32_t age;
+        while (read_microphone(frame, MICROPHONE_SAMPLE_RATE / 200, &age)) {
+            ++frames;
+            if (age > max_age) max_age = age;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000L + (now.tv_nsec - start.tv_nsec) < 1000000000L);
+
+    printf("%-24s %5u frames in 1 s, max age %5u us\n", "microphone", frames, max_age);
+    close_microphone();
+}
+
+// Sends numbered datagrams over loopback through the network impairment emulation and counts what arrives.
+// The impairments apply when sending and again when receiving. The same seed always gives the same result.
+static void run_impairment_scenario(const char* name, const impairment_settings* settings) {
+    const uint32_t datagram_count = 2000;
+
+    int receiver = init_udp_socket(IMPAIRMENT_PORT);
+    int sender = init_udp_socket(0);
+    if (receiver < 0 || sender < 0) {
+        printf("%-24s could not open sockets\n", name);
+        destroy_udp_socket(&receiver);
+        destroy_udp_socket(&sender);
+        return;
+    }
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(IMPAIRMENT_PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    configure_impairment(settings);
+
+    static uint8_t received[2000];
+    memset(received, 0, sizeof(received));
+    uint32_t delivered = 0, duplicated = 0, reordered = 0, highest = 0;
+
+    for (uint32_t sent = 0; ; ) {
+        // One datagram per millisecond, then wait for the delayed ones.
+        if (sent < datagram_count) {
+            send_udp_socket(sender, &sent, sizeof(sent), (const struct sockaddr*) &address, sizeof(address));
+            ++sent;
+        }
+
+        if (wait_udp_socket(receiver, sent < datagram_count ? 1000 : 200000) == 0 && sent == datagram_count) break;
+
+        uint32_t number;
+        while (receive_udp_socket(receiver, &number, sizeof(number), NULL, NULL) == sizeof(number)) {
+            if (number >= datagram_count) continue;
+
+            if (received[number]++) ++duplicated;
+            else ++delivered;
+
+            if (number < highest) ++reordered;
+            else highest = number;
+        }
+    }
+
+    printf("%-24s %5u sent %5u delivered %5u duplicated %5u reordered\n", name, datagram_count, delivered, duplicated, reordered);
+
+    destroy_udp_socket(&receiver);
+    destroy_udp_socket(&sender);
+}
+
+int main() {
+    generate_samples();
+
+    // A remapping with swapped face buttons and a curved stick response, so no lookup is trivial.
+    remap_settings settings;
+    reset_remap_settings(&settings);
+    set_button_remap(&settings, "a", "b");
+    set_button_remap(&settings, "b", "a");
+    settings.stick_deadzone = 0.1f;
+    settings.stick_exponent = 1.5f;
+    configure_remap(&settings);
+    init_dsu();
+
+    uint32_t mismatches = check_sample_conversion();
+    printf("convert_sample: %u of %d samples differ from the double precision formulas\n", mismatches, SAMPLE_COUNT);
+    if (mismatches > 0) return 1;
+
+    printf("%d samples, %d warmup iterations, %d repetitions of %d iterations\n\n", SAMPLE_COUNT, WARMUP_ITERATIONS, REPETITIONS, ITERATIONS);
+
+    run_benchmark("pack_controller_data", benchmark_pack_controller_data, 100);
+    run_benchmark("set_packet_header", benchmark_set_packet_header, 100);
+    run_benchmark("pack_gamepad_data", benchmark_pack_gamepad_data, 58);
+    run_benchmark("convert_sample", benchmark_convert_sample, sizeof(converted_sample));
+    run_benchmark("remap", benchmark_remap, sizeof(VPADStatus));
+    run_benchmark("pack_audio_packet", benchmark_pack_audio_packet, RWUG_AUDIO_HEADER_SIZE + MICROPHONE_SAMPLE_RATE / 100);
+    run_benchmark("bswap32f", benchmark_bswap32f, 4);
+    run_benchmark("bswap64f", benchmark_bswap64f, 8);
+
+    printf("\n");
+
+    const impairment_settings wifi = { 0.02f, 0.005f, 0.01f, 2000, 3000, 4242 };
+    const impairment_settings congested = { 0.1f, 0.01f, 0.05f, 20000, 15000, 4242 };
+    run_impairment_scenario("impairment wifi", &wifi);
+    run_impairment_scenario("impairment congested", &congested);
+    run_microphone_scenario();
+
+    return 0;
+}
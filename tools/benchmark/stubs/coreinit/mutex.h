@@ -0,0 +1,10 @@
+// Minimal stand-in for <coreinit/mutex.h> of wut. The host builds are single threaded, so locks do nothing.
+#pragma once
+
+typedef struct {
+    int count;
+} OSMutex;
+
+static inline void OSInitMutex(OSMutex* mutex) { mutex->count = 0; }
+static inline void OSLockMutex(OSMutex* mutex) { ++mutex->count; }
+static inline void OSUnlockMutex(OSMutex* mutex) { --mutex->count; }
@@ -0,0 +1,11 @@
+// Minimal stand-in for <coreinit/screen.h> of wut, which only provides what the host builds use.
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    SCREEN_TV  = 0,
+    SCREEN_DRC = 1
+} OSScreenID;
+
+void OSScreenEnableEx(OSScreenID screen, uint32_t enable);
@@ -0,0 +1,11 @@
+// Minimal stand-in for <coreinit/time.h> of wut. Ticks are microseconds on the host.
+#pragma once
+
+#include <stdint.h>
+
+typedef int64_t OSTime;
+
+OSTime OSGetSystemTime();
+
+#define OSTicksToMicroseconds(ticks) (ticks)
+#define OSMicrosecondsToTicks(microseconds) (microseconds)
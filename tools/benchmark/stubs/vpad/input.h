@@ -0,0 +1,106 @@
+// Minimal stand-in for <vpad/input.h> of wut, which only provides what the host builds use.
+#pragma once
+
+#include <stdint.h>
+
+typedef enum {
+    VPAD_CHAN_0 = 0
+} VPADChan;
+
+typedef enum {
+    VPAD_READ_SUCCESS     =  0,
+    VPAD_READ_NO_SAMPLES  = -1
+} VPADReadError;
+
+typedef enum {
+    VPAD_TP_1920X1080 = 0,
+    VPAD_TP_1280X720  = 1,
+    VPAD_TP_854X480   = 2
+} VPADTouchPadResolution;
+
+typedef enum {
+    VPAD_LCD_STANDBY = 0x00,
+    VPAD_LCD_ON      = 0xFF
+} VPADLcdMode;
+
+typedef enum {
+    VPAD_BUTTON_SYNC    = 0x00000001,
+    VPAD_BUTTON_HOME    = 0x00000002,
+    VPAD_BUTTON_MINUS   = 0x00000004,
+    VPAD_BUTTON_PLUS    = 0x00000008,
+    VPAD_BUTTON_R       = 0x00000010,
+    VPAD_BUTTON_L       = 0x00000020,
+    VPAD_BUTTON_ZR      = 0x00000040,
+    VPAD_BUTTON_ZL      = 0x00000080,
+    VPAD_BUTTON_DOWN    = 0x00000100,
+    VPAD_BUTTON_UP      = 0x00000200,
+    VPAD_BUTTON_RIGHT   = 0x00000400,
+    VPAD_BUTTON_LEFT    = 0x00000800,
+    VPAD_BUTTON_Y       = 0x00001000,
+    VPAD_BUTTON_X       = 0x00002000,
+    VPAD_BUTTON_B       = 0x00004000,
+    VPAD_BUTTON_A       = 0x00008000,
+    VPAD_BUTTON_TV      = 0x00010000,
+    VPAD_BUTTON_STICK_R = 0x00020000,
+    VPAD_BUTTON_STICK_L = 0x00040000
+} VPADButtons;
+
+typedef struct {
+    float x;
+    float y;
+} VPADVec2D;
+
+typedef struct {
+    float x;
+    float y;
+    float z;
+} VPADVec3D;
+
+typedef struct {
+    VPADVec3D x;
+    VPADVec3D y;
+    VPADVec3D z;
+} VPADDirection;
+
+typedef struct {
+    uint16_t x;
+    uint16_t y;
+    uint16_t touched;
+    uint16_t validity;
+} VPADTouchData;
+
+typedef struct {
+    VPADVec3D acc;
+    float magnitude;
+    float variation;
+    VPADVec2D vertical;
+} VPADAccStatus;
+
+typedef struct {
+    uint32_t hold;
+    uint32_t trigger;
+    uint32_t release;
+    VPADVec2D leftStick;
+    VPADVec2D rightStick;
+    VPADAccStatus accelorometer;
+    VPADVec3D gyro;
+    VPADVec3D angle;
+    uint8_t error;
+    VPADTouchData tpNormal;
+    VPADTouchData tpFiltered1;
+    VPADTouchData tpFiltered2;
+    VPADDirection direction;
+    uint8_t usingHeadphones;
+    VPADVec3D mag;
+    uint8_t slideVolume;
+    uint8_t battery;
+    uint8_t micStatus;
+    uint8_t slideVolumeEx;
+} VPADStatus;
+
+void VPADStopMotor(VPADChan chan);
+int32_t VPADControlMotor(VPADChan chan, uint8_t* pattern, uint8_t length);
+
+int32_t VPADRead(VPADChan chan, VPADStatus* buffers, uint32_t count, VPADReadError* outError);
+void VPADGetTPCalibratedPointEx(VPADChan chan, VPADTouchPadResolution tpReso, VPADTouchData* calibratedData, const VPADTouchData* uncalibratedData);
+int32_t VPADSetLcdMode(VPADChan chan, VPADLcdMode lcdMode);
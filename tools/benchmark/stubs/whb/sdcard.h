@@ -0,0 +1,4 @@
+// Minimal stand-in for <whb/sdcard.h> of wut.
+#pragma once
+
+char* WHBGetSdCardMountPath();
@@ -0,0 +1,107 @@
+#!/usr/bin/env python3
+# Converts a flight recorder dump of the RWUG client (sd:/wiiu/apps/RWUG/flight_recorder_<n>.bin)
+# into the Chrome trace event format, which can be opened in chrome://tracing or https://ui.perfetto.dev.
+
+import argparse
+import ipaddress
+import json
+import struct
+import sys
+
+MAGIC = b"RWUGFR01"
+EVENT = struct.Struct(">QIHBx")
+
+# Types of source/flight_recorder.h.
+LOOP_START = 1
+EVENT_NAMES = {
+    1: "loop",
+    2: "VPADRead",
+    3: "RWUG sendto",
+    4: "DSU sendto",
+    5: "DSU request",
+    6: "rumble",
+    7: "deadline overrun",
+    8: "dump",
+}
+
+DSU_REQUEST_NAMES = {0: "protocol information", 1: "controller information", 2: "controller data"}
+RUMBLE_COMMAND_NAMES = {1: "play", 2: "stop"}
+
+
+def read_events(path):
+    with open(path, "rb") as file:
+        data = file.read()
+
+    if data[:8] != MAGIC:
+        sys.exit(f"{path} is not a flight recorder dump")
+
+    (count,) = struct.unpack_from(">I", data, 8)
+    return [EVENT.unpack_from(data, 12 + i * EVENT.size) for i in range(count)]
+
+
+def to_trace_event(event, start, next_loop_start):
+    time, argument, detail, event_type = event
+    name = EVENT_NAMES.get(event_type, f"unknown {event_type}")
+    trace_event = {"name": name, "pid": 1, "tid": 1, "ts": time - start}
+
+    if event_type == LOOP_START:
+        trace_event["args"] = {"period_us": argument}
+        if next_loop_start is None:
+            trace_event["ph"] = "i"
+            trace_event["s"] = "t"
+        else:
+            trace_event["ph"] = "X"
+            trace_event["dur"] = next_loop_start - time
+        return trace_event
+
+    trace_event["ph"] = "i"
+    trace_event["s"] = "g" if event_type in (7, 8) else "t"
+
+    if event_type == 2:
+        trace_event["args"] = {"samples": struct.unpack(">i", struct.pack(">I", argument))[0]}
+    elif event_type in (3, 4):
+        trace_event["args"] = {"result": struct.unpack(">i", struct.pack(">I", argument))[0]}
+    elif event_type == 5:
+        trace_event["args"] = {"sender": str(ipaddress.IPv4Address(argument)), "request": DSU_REQUEST_NAMES.get(detail, detail)}
+    elif event_type == 6:
+        trace_event["args"] = {"command": RUMBLE_COMMAND_NAMES.get(detail, detail), "length_ms": argument}
+    elif event_type == 7:
+        trace_event["args"] = {"delay_us": argument}
+    else:
+        trace_event["args"] = {"argument": argument, "detail": detail}
+
+    return trace_event
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Converts RWUG flight recorder dumps to Chrome trace JSON.")
+    parser.add_argument("dump")
+    parser.add_argument("output", nargs="?", help="output file (default: stdout)")
+    args = parser.parse_args()
+
+    events = read_events(args.dump)
+    if not events:
+        sys.exit("the dump contains no events")
+
+    start = events[0][0]
+    loop_starts = [event[0] for event in events if event[3] == LOOP_START]
+
+    trace_events = []
+    loop_index = 0
+    for event in events:
+        next_loop_start = None
+        if event[3] == LOOP_START:
+            loop_index += 1
+            next_loop_start = loop_starts[loop_index] if loop_index < len(loop_starts) else None
+        trace_events.append(to_trace_event(event, start, next_loop_start))
+
+    trace = json.dumps({"traceEvents": trace_events, "displayTimeUnit": "ms"}, indent=1)
+    if args.output:
+        with open(args.output, "w") as file:
+            file.write(trace)
+    else:
+        print(trace)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,940 @@
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <coreinit/time.h>
+#include <coreinit/screen.h>
+#include <vpad/input.h>
+#include <whb/sdcard.h>
+#include <arpa/inet.h>
+
+#include "byte_swap.h"
+#include "configuration.h"
+#include "flight_recorder.h"
+#include "prediction.h"
+#include "telemetry.h"
+#include "udp_socket.h"
+#include "streaming.h"
+#include "rwug.h"
+#include "dsu.h"
+
+// Drives the send path of the client (streaming.c) like the main loop does, but on a simulated clock, so days of
+// streaming pass in minutes. The clock, VPAD and the SD card are simulated below. Stand-ins for a DSU client, two RWUG
+// servers and a telemetry collector receive everything over loopback and check it against the budgets below.
+// Exits with 1 if any check failed.
+
+// Simulated days if none are given on the command line.
+#define DEFAULT_DAYS 3
+
+#define SECOND 1000000ULL
+#define MINUTE (60 * SECOND)
+#define HOUR (60 * MINUTE)
+#define DAY (24 * HOUR)
+
+// Time the console runs before the client starts streaming, in microseconds.
+#define START_TIME (20 * SECOND)
+
+// Time between two GamePad samples, in microseconds.
+#define SAMPLE_INTERVAL 5000
+
+// Loopback ports. The client's socket also serves the first DSU server, the second DSU server has its own socket.
+#define CLIENT_PORT 4310
+#define SECOND_DSU_PORT 4313
+#define RWUG_PORT 4311
+#define COLLECTOR_PORT 4312
+
+// The configuration on the simulated SD card. The padding makes the file larger than 4 KB, so saving it must keep
+// what comes after the first 4 KB.
+#define UPDATE_INTERVAL 10000
+#define IDLE_TIMEOUT 30
+#define SCREEN_TIMEOUT 60
+#define CONFIGURATION_PADDING_LINES 80
+
+// The loop wakes up late by up to MAX_JITTER microseconds. Every 10 minutes it hitches, and twice a day the clock
+// jumps forward, like after the console was busy elsewhere. Each of them is expected to dump the flight recorder.
+#define MAX_JITTER 1500
+#define HITCH_INTERVAL (10 * MINUTE)
+#define HITCH_OFFSET (5 * MINUTE)
+#define HITCH_LENGTH 30000
+#define CLOCK_JUMP_INTERVAL (12 * HOUR)
+#define CLOCK_JUMP_OFFSET (11 * HOUR + 52 * MINUTE + 30 * SECOND)
+#define CLOCK_JUMP_LENGTH (5 * SECOND)
+
+// The GamePad rests during these minutes of every hour. Its screen is off before the DSU client goes away, as requests
+// don't keep it on, and back on after the GamePad is used again.
+#define REST_START (25 * MINUTE)
+#define REST_END (40 * MINUTE)
+#define SCREEN_OFF_CHECK (29 * MINUTE)
+#define SCREEN_ON_CHECK (41 * MINUTE)
+
+// Once a day, ZL + ZR + minus requests a flight recorder dump.
+#define DUMP_COMBO_TIME (3 * HOUR + 10 * MINUTE)
+#define DUMP_COMBO_LENGTH SECOND
+
+// The DSU client requests data every second, like Cemu. Once per hour it goes away for a while, so its subscriptions
+// expire (after 30 seconds, see dsu.c). While it's away and the GamePad rests, the client idles, and only then.
+#define DSU_REQUEST_INTERVAL SECOND
+#define DSU_SUBSCRIPTION_TIMEOUT (30 * SECOND)
+#define DSU_PAUSE_START (30 * MINUTE)
+#define DSU_PAUSE (2 * MINUTE)
+#define IDLE_WINDOW_START DSU_PAUSE_START
+#define IDLE_WINDOW_END (DSU_PAUSE_START + DSU_PAUSE + MINUTE)
+
+// Every few hours the RWUG server moves to the other loopback address. The new one answers a discovery, which starts
+// like at startup, and ignores hellos for a while, so the client retries.
+#define RWUG_SERVER_COUNT 2
+#define RWUG_MOVE_INTERVAL (6 * HOUR)
+#define RWUG_STARTUP_TIME (12 * SECOND)
+#define DISCOVERY_TIMEOUT 500000
+#define RWUG_SERVER_FEATURES (RWUG_FEATURE_SEQUENCE | RWUG_FEATURE_ORIENTATION | RWUG_FEATURE_EDGES)
+#define RWUG_RATE 100
+
+// Time between force feedback commands of the RWUG server, in microseconds.
+#define RUMBLE_INTERVAL (10 * MINUTE)
+
+// Counters start this far before they wrap around, so every run also covers the wrap.
+#define COUNTER_HEADROOM 100000
+
+// Budgets. The client doesn't keep any allocation while streaming, also not when it saves its configuration, and
+// loopback doesn't drop anything, so neither is allowed. Heap growth is measured from the end of the first simulated
+// hour, after all buffers have been allocated.
+#define MAX_HEAP_GROWTH 0
+#define MAX_ERROR_RATE 0.0
+
+// Loop periods are published in buckets of this width (see telemetry.c). Every telemetry line that isn't idle and
+// doesn't cover a hitch must stay within these bounds, and the median loop_p99 of an hour must not drift from the
+// first hour's by more than MAX_LOOP_DRIFT, in microseconds.
+#define LOOP_BUCKET_WIDTH 250
+#define MAX_LOOP_P50 (UPDATE_INTERVAL + 2 * LOOP_BUCKET_WIDTH)
+#define MAX_LOOP_P99 (UPDATE_INTERVAL + MAX_JITTER + LOOP_BUCKET_WIDTH)
+#define MAX_LOOP_DRIFT 500
+#define MAX_LINES_PER_HOUR 4000
+
+// Later violations are only counted.
+#define MAX_REPORTED_FAILURES 20
+
+// Layout of the packets, see dsu.c and rwug.c.
+#define DSU_DATA_SIZE 100
+#define RWUG_OUT_SIZE 58
+#define RWUG_EXTENSION_SEQUENCE 0x01
+#define RWUG_HANDSHAKE_SIZE 16
+#define RWUG_DISCOVERY_SIZE 8
+
+typedef struct {
+    uint64_t dsu_packets;
+    uint64_t dsu_replies;
+    uint64_t rwug_packets;
+    uint32_t handshakes;
+    uint32_t rumble_commands;
+    uint32_t telemetry_lines;
+    uint32_t idle_lines;
+    uint32_t server_moves;
+    uint32_t disturbances;
+    uint32_t hitch_dumps;
+    uint32_t combo_dumps;
+} soak_statistics;
+
+// An RWUG server on its own loopback address, which answers the client once it knows it from a hello.
+typedef struct {
+    int socket;
+    struct sockaddr_in address;
+    struct sockaddr_in client_address;
+    bool client_known;
+    uint64_t ready_time;
+} rwug_stand_in;
+
+// The simulated clock, and its value before the last step.
+static uint64_t now = START_TIME;
+static uint64_t previous_now = START_TIME;
+static uint32_t random_state = 1;
+
+static uint32_t failures = 0;
+static soak_statistics statistics;
+
+// The simulated hardware.
+static char sd_card_path[64];
+static uint64_t last_sample_time = START_TIME;
+static VPADLcdMode lcd_mode = VPAD_LCD_ON;
+
+// The client under test, set up like main.c does.
+static char configuration_path[256];
+static long configuration_size;
+static configuration config;
+static int client_socket = -1;
+static dsu_server dsu_servers[2];
+static struct sockaddr_in rwug_server_address;
+static struct sockaddr_in telemetry_address;
+static send_state state;
+static discovery_state discovery;
+
+// The stand-ins.
+static int dsu_client_socket = -1;
+static int collector_socket = -1;
+static struct sockaddr_in dsu_addresses[2];
+static rwug_stand_in rwug_servers[RWUG_SERVER_COUNT] = { { .socket = -1 }, { .socket = -1 } };
+static uint8_t current_rwug_server = 0;
+
+// Set while the client is expected to move to the current RWUG server once the discovery ends.
+static bool move_pending = false;
+
+static uint64_t last_dsu_request = 0;
+static bool dsu_paused = true;
+static bool dsu_number_known[2] = { false, false };
+static uint32_t last_dsu_number[2];
+static bool rwug_sequence_known = false;
+static uint32_t last_rwug_sequence;
+
+// Values of the previous telemetry line, and the packets the stand-ins had received by the first one.
+static bool telemetry_known = false;
+static uint64_t last_uptime;
+static uint32_t last_samples, last_rwug_sent, last_dsu_sent, last_send_errors, last_rumble;
+static uint32_t first_dsu_sent, first_rwug_sent;
+static uint64_t first_dsu_packets, first_rwug_packets;
+
+// The next telemetry line covers a hitch, a jump of the clock or the end of the idle state, which may dominate its
+// loop periods.
+static bool disturbed = false;
+static uint64_t clock_jumped = 0;
+
+// loop_p99 of the undisturbed lines of the current hour, and the median of the first hour.
+static uint32_t hour_loop_p99[MAX_LINES_PER_HOUR];
+static uint32_t hour_line_count = 0;
+static uint32_t hour_idle_lines = 0;
+static uint32_t baseline_loop_p99 = 0;
+
+static size_t heap_baseline;
+static bool heap_measured = false;
+static long heap_growth = 0;
+
+static void fail(const char* format, ...) {
+    if (failures++ >= MAX_REPORTED_FAILURES) return;
+
+    uint64_t seconds = now / 1000000;
+    printf("day %llu %02llu:%02llu:%02llu.%03llu: ",
+        (unsigned long long) (seconds / 86400), (unsigned long long) (seconds / 3600 % 24),
+        (unsigned long long) (seconds / 60 % 60), (unsigned long long) (seconds % 60),
+        (unsigned long long) (now / 1000 % 1000));
+
+    va_list arguments;
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+
+    printf("\n");
+}
+
+// Deterministic, so every run sees the same jitter.
+static uint32_t next_random() {
+    random_state = random_state * 1103515245 + 12345;
+    return random_state >> 16;
+}
+
+// Whether the last step of the clock passed the given offset into a period, e.g. minute 39 of every hour.
+static bool passed(const uint64_t period, const uint64_t offset) {
+    return (now + period - offset) / period != (previous_now + period - offset) / period;
+}
+
+static bool is_within(const uint64_t time, const uint64_t period, const uint64_t start, const uint64_t end) {
+    return time % period >= start && time % period < end;
+}
+
+static void set_address(struct sockaddr_in* address, const char* ip_address, const uint16_t port) {
+    memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    inet_pton(AF_INET, ip_address, &address->sin_addr);
+}
+
+static size_t get_heap_used() {
+    return mallinfo2().uordblks;
+}
+
+// The clock, VPAD and the SD card of the console. The flight recorder only counts the dumps it's asked for.
+
+OSTime OSGetSystemTime() {
+    return now;
+}
+
+void OSScreenEnableEx(OSScreenID screen, uint32_t enable) {}
+
+char* WHBGetSdCardMountPath() {
+    return sd_card_path;
+}
+
+void VPADStopMotor(VPADChan chan) {}
+int32_t VPADControlMotor(VPADChan chan, uint8_t* pattern, uint8_t length) { return 0; }
+
+int32_t VPADSetLcdMode(VPADChan chan, VPADLcdMode mode) {
+    lcd_mode = mode;
+    return 0;
+}
+
+void VPADGetTPCalibratedPointEx(VPADChan chan, VPADTouchPadResolution resolution, VPADTouchData* calibrated, const VPADTouchData* uncalibrated) {
+    *calibrated = *uncalibrated;
+}
+
+void record_flight_event(const flight_event_type type, const uint32_t argument, const uint16_t detail) {}
+
+bool dump_flight_recorder() {
+    return true;
+}
+
+static bool is_resting(const uint64_t time) {
+    return is_within(time, HOUR, REST_START, REST_END);
+}
+
+// A few buttons pressed now and then, including taps that are shorter than an update.
+static uint32_t get_held_buttons(const uint64_t time) {
+    if (is_resting(time)) return 0;
+
+    const uint64_t sample = time / SAMPLE_INTERVAL;
+    uint32_t hold = 0;
+    if (sample % 74 < 10)     hold |= VPAD_BUTTON_A;
+    if (sample % 202 < 6)     hold |= VPAD_BUTTON_ZR;
+    if (sample % 1994 < 100)  hold |= VPAD_BUTTON_LEFT;
+    if (sample % 1000 == 500) hold |= VPAD_BUTTON_B;
+
+    if (is_within(time, DAY, DUMP_COMBO_TIME, DUMP_COMBO_TIME + DUMP_COMBO_LENGTH)) {
+        hold |= VPAD_BUTTON_ZL | VPAD_BUTTON_ZR;
+        if (is_within(time, DAY, DUMP_COMBO_TIME + DUMP_COMBO_LENGTH / 2, DUMP_COMBO_TIME + DUMP_COMBO_LENGTH)) hold |= VPAD_BUTTON_MINUS;
+    }
+
+    return hold;
+}
+
+// A GamePad that is moved around, except while it rests.
+static void simulate_sample(VPADStatus* pad, const uint64_t time) {
+    memset(pad, 0, sizeof(*pad));
+
+    const uint32_t previous_hold = get_held_buttons(time - SAMPLE_INTERVAL);
+    pad->hold = get_held_buttons(time);
+    pad->trigger = pad->hold & ~previous_hold;
+    pad->release = previous_hold & ~pad->hold;
+
+    pad->accelorometer.acc.y = -1.0f;
+    if (is_resting(time)) return;
+
+    float phase = (float) (time / SAMPLE_INTERVAL % 200000) * 0.005f;
+
+    pad->leftStick.x  = sinf(phase);
+    pad->leftStick.y  = cosf(phase);
+    pad->rightStick.x = sinf(phase * 0.3f);
+
+    pad->accelorometer.acc.x = 0.1f * sinf(phase);
+    pad->accelorometer.acc.z = 0.1f * cosf(phase);
+
+    pad->gyro.x = 0.05f * cosf(phase);
+    pad->gyro.y = 0.02f;
+    pad->gyro.z = -0.05f * sinf(phase);
+}
+
+// Like VPAD, returns every sample since the last read up to the size of the buffer, newest first.
+int32_t VPADRead(VPADChan chan, VPADStatus* buffers, uint32_t count, VPADReadError* error) {
+    const uint64_t newest = now / SAMPLE_INTERVAL * SAMPLE_INTERVAL;
+    uint64_t available = (newest - last_sample_time) / SAMPLE_INTERVAL;
+    if (available == 0) {
+        *error = VPAD_READ_NO_SAMPLES;
+        return 0;
+    }
+
+    if (available > count) available = count;
+    for (uint32_t i = 0; i < available; ++i) simulate_sample(&buffers[i], newest - i * SAMPLE_INTERVAL);
+
+    last_sample_time = newest;
+    *error = VPAD_READ_SUCCESS;
+    return available;
+}
+
+static long get_file_size(const char* path) {
+    struct stat status;
+    return stat(path, &status) == 0 ? status.st_size : -1;
+}
+
+static bool write_configuration() {
+    FILE* file = fopen(configuration_path, "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "[rwug]\nhistory_length=4\nedges=1\n\n");
+    fprintf(file, "[general]\nip_address=127.0.0.1\nmode=0\nauto_start=1\n\n");
+    fprintf(file, "[prediction]\nlatency=8000\nalpha=0.5\nbeta=0.1\n\n");
+    for (uint32_t i = 0; i < CONFIGURATION_PADDING_LINES; ++i) {
+        fprintf(file, "; padding line %02lu, which makes the file larger than the buffer it once had to fit into\n", (unsigned long) i);
+    }
+    fprintf(file, "\n[power]\nidle_timeout=%d\nscreen_timeout=%d\n\n", IDLE_TIMEOUT, SCREEN_TIMEOUT);
+    fprintf(file, "[timing]\nsend_interval=%d\naverage_motion=1\n\n", UPDATE_INTERVAL);
+    fprintf(file, "[sticks]\ndeadzone=0.05\nexponent=1.0\n\n");
+    fprintf(file, "[dsu]\nports=%d, %d\n\n", CLIENT_PORT, SECOND_DSU_PORT);
+    fprintf(file, "[telemetry]\naddress=127.0.0.1\nport=%d\n", COLLECTOR_PORT);
+
+    fclose(file);
+
+    configuration_size = get_file_size(configuration_path);
+    return true;
+}
+
+// Like the main loop after the discovery moved the client: saves the new address and keeps everything else.
+static void save_moved_server() {
+    inet_ntop(AF_INET, &rwug_server_address.sin_addr, config.ip_address, sizeof(config.ip_address));
+    save_configuration(configuration_path, &config);
+
+    configuration saved = load_configuration(configuration_path);
+    if (!saved.loaded || strcmp(saved.ip_address, config.ip_address) != 0) fail("configuration: saved %s, loaded %s", config.ip_address, saved.ip_address);
+
+    if (saved.history_length != config.history_length || saved.prediction_latency != config.prediction_latency ||
+        saved.idle_timeout != config.idle_timeout || saved.send_interval != config.send_interval ||
+        saved.dsu_port_count != config.dsu_port_count || saved.dsu_ports[1] != config.dsu_ports[1] ||
+        saved.telemetry_port != config.telemetry_port || saved.remap.stick_deadzone != config.remap.stick_deadzone) {
+        fail("configuration: sections were lost when saving");
+    }
+
+    // Both addresses have the same length, so the file keeps its size.
+    long size = get_file_size(configuration_path);
+    if (size != configuration_size) fail("configuration: %ld bytes after saving, %ld before", size, configuration_size);
+}
+
+static void send_dsu_request(const uint8_t server, const uint8_t type) {
+    uint8_t request[28];
+    memset(request, 0, sizeof(request));
+    memcpy(request, "DSUC", 4);
+    request[16] = type;
+
+    sendto(dsu_client_socket, request, sizeof(request), 0, (const struct sockaddr*) &dsu_addresses[server], sizeof(dsu_addresses[server]));
+}
+
+// Requests from both DSU servers like a DSU client, which starts with the protocol and controller information.
+static void update_dsu_client() {
+    const bool paused = is_within(now, HOUR, DSU_PAUSE_START, DSU_PAUSE_START + DSU_PAUSE);
+    const bool request_due = !paused && now - last_dsu_request >= DSU_REQUEST_INTERVAL;
+
+    for (uint8_t server = 0; server < 2; ++server) {
+        if (dsu_paused && !paused) {
+            send_dsu_request(server, 0x00);
+            send_dsu_request(server, 0x01);
+        }
+
+        if (request_due) send_dsu_request(server, 0x02);
+    }
+
+    if (request_due) last_dsu_request = now;
+    dsu_paused = paused;
+}
+
+static void receive_dsu_client() {
+    uint8_t packet[DSU_OUTGOING_BUFFER_SIZE];
+    struct sockaddr_in sender;
+    socklen_t sender_size = sizeof(sender);
+    ssize_t length;
+
+    while ((length = receive_udp_socket(dsu_client_socket, packet, sizeof(packet), (struct sockaddr*) &sender, &sender_size)) >= 0) {
+        sender_size = sizeof(sender);
+
+        if (length < 20 || memcmp(packet, "DSUS", 4) != 0) {
+            fail("dsu: unexpected datagram of %zd bytes", length);
+            continue;
+        }
+
+        // Protocol and controller information.
+        if (packet[16] != 0x02) {
+            ++statistics.dsu_replies;
+            continue;
+        }
+
+        if (length != DSU_DATA_SIZE) fail("dsu: data packet of %zd bytes", length);
+        ++statistics.dsu_packets;
+
+        if (now - last_dsu_request > DSU_SUBSCRIPTION_TIMEOUT) fail("dsu: data sent %llu us after the last request", (unsigned long long) (now - last_dsu_request));
+
+        // Fields are written with the same byte swap helpers, so the checks don't depend on the host's byte order.
+        uint32_t number;
+        uint64_t timestamp;
+        memcpy(&number, &packet[32], sizeof(number));
+        memcpy(&timestamp, &packet[68], sizeof(timestamp));
+        number = bswap32u(number);
+        timestamp = bswap64u(timestamp);
+
+        // Every server numbers its own packets.
+        const uint8_t server = ntohs(sender.sin_port) == SECOND_DSU_PORT ? 1 : 0;
+        if (dsu_number_known[server] && number != last_dsu_number[server] + 1) {
+            fail("dsu: packet number %lu after %lu on server %u", (unsigned long) number, (unsigned long) last_dsu_number[server], (unsigned int) server);
+        }
+        if (timestamp != now) fail("dsu: timestamp %llu", (unsigned long long) timestamp);
+
+        dsu_number_known[server] = true;
+        last_dsu_number[server] = number;
+    }
+}
+
+static void send_rwug_ack(rwug_stand_in* server) {
+    uint8_t packet[RWUG_HANDSHAKE_SIZE];
+    memcpy(&packet[0], "RWUGHACK", 8);
+
+    uint16_t version = bswap16u(2);
+    uint32_t features = bswap32u(RWUG_SERVER_FEATURES);
+    uint16_t rate = bswap16u(RWUG_RATE);
+
+    memcpy(&packet[8],  &version,  sizeof(version));
+    memcpy(&packet[10], &features, sizeof(features));
+    memcpy(&packet[14], &rate,     sizeof(rate));
+
+    sendto(server->socket, packet, sizeof(packet), 0, (const struct sockaddr*) &server->client_address, sizeof(server->client_address));
+    ++statistics.handshakes;
+}
+
+// Starts the discovery like main.c, with a deadline after which the client moves to the server that answered.
+// The broadcast probe can't reach the stand-ins on loopback, so the current server answers right away.
+static void start_discovery() {
+    memset(&discovery, 0, sizeof(discovery));
+    discovery.active = true;
+    discovery.deadline = now + DISCOVERY_TIMEOUT;
+
+    struct sockaddr_in client_address;
+    set_address(&client_address, "127.0.0.1", CLIENT_PORT);
+
+    const rwug_stand_in* server = &rwug_servers[current_rwug_server];
+    sendto(server->socket, "RWUGHERE", RWUG_DISCOVERY_SIZE, 0, (const struct sockaddr*) &client_address, sizeof(client_address));
+}
+
+static void update_rwug_servers() {
+    if (passed(RWUG_MOVE_INTERVAL, 0)) {
+        current_rwug_server = (current_rwug_server + 1) % RWUG_SERVER_COUNT;
+        rwug_servers[current_rwug_server].ready_time = now + RWUG_STARTUP_TIME;
+        rwug_servers[current_rwug_server].client_known = false;
+        move_pending = true;
+        ++statistics.server_moves;
+
+        start_discovery();
+    }
+
+    rwug_stand_in* server = &rwug_servers[current_rwug_server];
+    if (server->client_known && passed(RUMBLE_INTERVAL, 0)) {
+        uint16_t length = bswap16u(500);
+        uint8_t packet[4] = { 0x01, 0xFF };
+        memcpy(&packet[2], &length, sizeof(length));
+
+        sendto(server->socket, packet, sizeof(packet), 0, (const struct sockaddr*) &server->client_address, sizeof(server->client_address));
+        ++statistics.rumble_commands;
+    }
+}
+
+// Both servers count what arrives, so the packets that reach the previous server until the client moved count too.
+static void receive_rwug_server(rwug_stand_in* server, const bool current) {
+    uint8_t packet[256];
+    struct sockaddr_in sender;
+    socklen_t sender_size = sizeof(sender);
+    ssize_t length;
+
+    while ((length = receive_udp_socket(server->socket, packet, sizeof(packet), (struct sockaddr*) &sender, &sender_size)) >= 0) {
+        sender_size = sizeof(sender);
+
+        if (length == RWUG_HANDSHAKE_SIZE && memcmp(packet, "RWUGHELO", 8) == 0) {
+            if (!current) continue;
+
+            server->client_address = sender;
+            server->client_known = true;
+
+            if (now >= server->ready_time) send_rwug_ack(server);
+            continue;
+        }
+
+        if (length < RWUG_OUT_SIZE) {
+            fail("rwug: unexpected datagram of %zd bytes", length);
+            continue;
+        }
+
+        ++statistics.rwug_packets;
+
+        uint64_t timestamp;
+        memcpy(&timestamp, &packet[30], sizeof(timestamp));
+        timestamp = bswap64u(timestamp);
+        if (timestamp != now) fail("rwug: timestamp %llu", (unsigned long long) timestamp);
+
+        // Only packets with the sequence extension count, the legacy packets of a handshake in progress don't.
+        if (length > RWUG_OUT_SIZE + 6 && packet[RWUG_OUT_SIZE] == RWUG_EXTENSION_SEQUENCE) {
+            uint32_t sequence;
+            memcpy(&sequence, &packet[RWUG_OUT_SIZE + 2], sizeof(sequence));
+            sequence = bswap32u(sequence);
+
+            if (rwug_sequence_known && sequence != last_rwug_sequence + 1) fail("rwug: sequence %lu after %lu", (unsigned long) sequence, (unsigned long) last_rwug_sequence);
+
+            rwug_sequence_known = true;
+            last_rwug_sequence = sequence;
+        }
+    }
+}
+
+static bool get_field(char* line, const char* key, unsigned long long* value) {
+    char pattern[32];
+    snprintf(pattern, sizeof(pattern), " %s=", key);
+
+    char* field = strstr(line, pattern);
+    if (field == NULL) return false;
+
+    *value = strtoull(field + strlen(pattern), NULL, 10);
+    return true;
+}
+
+// Counters may wrap around, but never go back.
+static void check_counter(const char* key, const uint32_t previous, const uint32_t value) {
+    if ((uint32_t) (value - previous) >= 0x80000000) fail("telemetry: %s went back from %lu to %lu", key, (unsigned long) previous, (unsigned long) value);
+}
+
+static void check_loop_periods(const unsigned long long loop_p50, const unsigned long long loop_p99) {
+    if (loop_p50 > MAX_LOOP_P50) fail("telemetry: loop_p50 of %llu us", loop_p50);
+    if (loop_p99 > MAX_LOOP_P99) fail("telemetry: loop_p99 of %llu us", loop_p99);
+
+    if (hour_line_count < MAX_LINES_PER_HOUR) hour_loop_p99[hour_line_count++] = loop_p99;
+}
+
+static void receive_collector() {
+    char line[512];
+    ssize_t length;
+
+    while ((length = receive_udp_socket(collector_socket, line, sizeof(line) - 1, NULL, NULL)) >= 0) {
+        line[length] = '\0';
+
+        unsigned long long uptime, samples, rwug_sent, dsu_sent, send_errors, rumble, loop_p50, loop_p99, idle;
+        if (strncmp(line, "rwug ", 5) != 0 ||
+            !get_field(line, "uptime", &uptime) || !get_field(line, "samples", &samples) ||
+            !get_field(line, "rwug_sent", &rwug_sent) || !get_field(line, "dsu_sent", &dsu_sent) ||
+            !get_field(line, "send_errors", &send_errors) || !get_field(line, "rumble", &rumble) ||
+            !get_field(line, "loop_p50", &loop_p50) || !get_field(line, "loop_p99", &loop_p99) ||
+            !get_field(line, "idle", &idle)) {
+            fail("telemetry: unexpected line %s", line);
+            continue;
+        }
+
+        ++statistics.telemetry_lines;
+
+        if (idle) {
+            ++statistics.idle_lines;
+            ++hour_idle_lines;
+            if (!is_within(now, HOUR, IDLE_WINDOW_START, IDLE_WINDOW_END)) fail("telemetry: idle while the DSU client is subscribed");
+        }
+
+        if (!telemetry_known) {
+            first_dsu_sent = dsu_sent;
+            first_rwug_sent = rwug_sent;
+            first_dsu_packets = statistics.dsu_packets;
+            first_rwug_packets = statistics.rwug_packets;
+        } else {
+            // Lines are at least a second apart, so the uptime can skip a second, and more after a jump of the clock.
+            if (uptime <= last_uptime || uptime - last_uptime > 2 + clock_jumped / SECOND) fail("telemetry: uptime %llu after %llu", uptime, (unsigned long long) last_uptime);
+
+            check_counter("samples", last_samples, samples);
+            check_counter("rwug_sent", last_rwug_sent, rwug_sent);
+            check_counter("dsu_sent", last_dsu_sent, dsu_sent);
+            check_counter("send_errors", last_send_errors, send_errors);
+            check_counter("rumble", last_rumble, rumble);
+
+            // Everything the counters claim was sent arrived.
+            if ((uint32_t) (dsu_sent - first_dsu_sent) != (uint32_t) (statistics.dsu_packets - first_dsu_packets)) {
+                fail("telemetry: dsu_sent counted %lu packets, %llu arrived", (unsigned long) (uint32_t) (dsu_sent - first_dsu_sent), (unsigned long long) (statistics.dsu_packets - first_dsu_packets));
+            }
+            if ((uint32_t) (rwug_sent - first_rwug_sent) != (uint32_t) (statistics.rwug_packets - first_rwug_packets)) {
+                fail("telemetry: rwug_sent counted %lu packets, %llu arrived", (unsigned long) (uint32_t) (rwug_sent - first_rwug_sent), (unsigned long long) (statistics.rwug_packets - first_rwug_packets));
+            }
+
+            if (!idle && !disturbed) check_loop_periods(loop_p50, loop_p99);
+        }
+
+        telemetry_known = true;
+        disturbed = false;
+        clock_jumped = 0;
+        last_uptime = uptime;
+        last_samples = samples;
+        last_rwug_sent = rwug_sent;
+        last_dsu_sent = dsu_sent;
+        last_send_errors = send_errors;
+        last_rumble = rumble;
+    }
+}
+
+static int compare_periods(const void* a, const void* b) {
+    const uint32_t first = *(const uint32_t*) a;
+    const uint32_t second = *(const uint32_t*) b;
+    return first < second ? -1 : first > second;
+}
+
+// The client idles once per hour, and its loop periods don't drift from the first hour's.
+static void check_hour() {
+    if (hour_idle_lines == 0) fail("telemetry: never idle within the hour");
+
+    if (hour_line_count > 0) {
+        qsort(hour_loop_p99, hour_line_count, sizeof(hour_loop_p99[0]), compare_periods);
+        uint32_t median = hour_loop_p99[(hour_line_count - 1) / 2];
+
+        if (baseline_loop_p99 == 0) baseline_loop_p99 = median;
+        else if (median > baseline_loop_p99 + MAX_LOOP_DRIFT) fail("telemetry: median loop_p99 drifted from %lu to %lu us", (unsigned long) baseline_loop_p99, (unsigned long) median);
+    } else {
+        fail("telemetry: no undisturbed line within the hour");
+    }
+
+    hour_line_count = 0;
+    hour_idle_lines = 0;
+}
+
+static void check_heap() {
+    size_t used = get_heap_used();
+
+    if (!heap_measured) {
+        heap_baseline = used;
+        heap_measured = true;
+        return;
+    }
+
+    heap_growth = (long) used - (long) heap_baseline;
+    if (heap_growth > MAX_HEAP_GROWTH) fail("heap: grew by %ld bytes", heap_growth);
+}
+
+static uint32_t get_packets_sent() {
+    return dsu_servers[0].statistics.packets_sent + dsu_servers[1].statistics.packets_sent + telemetry.rwug_packets_sent;
+}
+
+static uint32_t get_send_errors() {
+    return dsu_servers[0].statistics.send_errors + dsu_servers[1].statistics.send_errors + telemetry.send_errors;
+}
+
+static void check_send_errors(const uint32_t first_errors, const uint32_t first_sent) {
+    uint32_t errors = get_send_errors() - first_errors;
+    uint32_t sent = get_packets_sent() - first_sent;
+
+    if (errors > 0 && (double) errors / ((double) sent + errors) > MAX_ERROR_RATE) fail("send errors: %lu of %lu sends failed", (unsigned long) errors, (unsigned long) (sent + errors));
+}
+
+// The screen turns off after the GamePad rested for a while, even while requests arrive, and back on with the first press.
+static void check_screen() {
+    if (passed(HOUR, SCREEN_OFF_CHECK) && lcd_mode != VPAD_LCD_STANDBY) fail("power: screen still on after resting while requests arrive");
+    if (passed(HOUR, SCREEN_ON_CHECK) && lcd_mode != VPAD_LCD_ON) fail("power: screen still off after presses");
+}
+
+// The client moves to the server that answered the discovery once the previous one stayed silent until the deadline.
+static void check_discovery(const bool moved) {
+    if (moved) {
+        if (!move_pending) fail("discovery: moved without a new server");
+        else if (rwug_server_address.sin_addr.s_addr != rwug_servers[current_rwug_server].address.sin_addr.s_addr) fail("discovery: moved to the wrong server");
+
+        move_pending = false;
+        save_moved_server();
+    } else if (move_pending && !discovery.active) {
+        fail("discovery: ended without moving to the new server");
+        move_pending = false;
+    }
+}
+
+// Like an iteration of the main loop, except that the wait is a step of the simulated clock.
+static OSTime update(OSTime next_update) {
+    // Wakes up late by some jitter, and now and then a lot later.
+    previous_now = now;
+    now = next_update + next_random() % (MAX_JITTER + 1);
+
+    if (passed(HITCH_INTERVAL, HITCH_OFFSET)) {
+        now += HITCH_LENGTH;
+        disturbed = true;
+        ++statistics.disturbances;
+    }
+    if (passed(CLOCK_JUMP_INTERVAL, CLOCK_JUMP_OFFSET)) {
+        now += CLOCK_JUMP_LENGTH;
+        clock_jumped += CLOCK_JUMP_LENGTH;
+        disturbed = true;
+        ++statistics.disturbances;
+    }
+
+    update_dsu_client();
+    update_rwug_servers();
+
+    receive_datagrams(&state, &discovery);
+    check_discovery(update_discovery(&state, &discovery));
+
+    // Incoming requests end the idle state right away.
+    const bool idle = state.power == POWER_IDLE;
+    if (idle && get_power_state() == POWER_ACTIVE) {
+        state.power = POWER_ACTIVE;
+        next_update = now;
+    }
+
+    next_update = send_scheduled(&state, next_update, now);
+
+    // The first period after idling is as long as an idle one.
+    if (idle && state.power == POWER_ACTIVE) disturbed = true;
+
+    if (state.dump_requested) ++statistics.combo_dumps;
+    else if (state.hitch_dump_due != 0 && now >= state.hitch_dump_due) ++statistics.hitch_dumps;
+    write_flight_recorder_dumps(&state);
+
+    if (state.mutex.count != 0) fail("mutex: locked %d times after an update", state.mutex.count);
+
+    receive_dsu_client();
+    for (uint8_t i = 0; i < RWUG_SERVER_COUNT; ++i) receive_rwug_server(&rwug_servers[i], i == current_rwug_server);
+    receive_collector();
+
+    return next_update;
+}
+
+static bool open_rwug_server(rwug_stand_in* server, const char* ip_address) {
+    set_address(&server->address, ip_address, RWUG_PORT);
+
+    server->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (server->socket >= 0 && bind(server->socket, (const struct sockaddr*) &server->address, sizeof(server->address)) < 0) destroy_udp_socket(&server->socket);
+
+    return server->socket >= 0;
+}
+
+static bool open_sockets() {
+    client_socket = init_udp_socket(config.dsu_ports[0]);
+    dsu_client_socket = init_udp_socket(0);
+    collector_socket = init_udp_socket(COLLECTOR_PORT);
+
+    set_address(&dsu_addresses[0], "127.0.0.1", config.dsu_ports[0]);
+    set_address(&dsu_addresses[1], "127.0.0.1", config.dsu_ports[1]);
+
+    return client_socket >= 0 && dsu_client_socket >= 0 && collector_socket >= 0 &&
+        open_rwug_server(&rwug_servers[0], "127.0.0.1") && open_rwug_server(&rwug_servers[1], "127.0.0.2") &&
+        init_dsu_server(&dsu_servers[0], client_socket, config.dsu_ports[0], DSU_DEFAULT_SERVER_ID) &&
+        init_dsu_server(&dsu_servers[1], -1, config.dsu_ports[1], DSU_DEFAULT_SERVER_ID + 1);
+}
+
+static void close_sockets() {
+    destroy_dsu_server(&dsu_servers[1]);
+    destroy_dsu_server(&dsu_servers[0]);
+    destroy_udp_socket(&client_socket);
+    destroy_udp_socket(&dsu_client_socket);
+    destroy_udp_socket(&collector_socket);
+    for (uint8_t i = 0; i < RWUG_SERVER_COUNT; ++i) destroy_udp_socket(&rwug_servers[i].socket);
+}
+
+// The simulated SD card is a temporary directory with the configuration of the client.
+static bool create_sd_card() {
+    strcpy(sd_card_path, "/tmp/rwug_soak.XXXXXX");
+    if (mkdtemp(sd_card_path) == NULL) return false;
+
+    char path[256];
+    const char* directories[] = { "wiiu", "wiiu/apps", "wiiu/apps/RWUG" };
+    for (uint8_t i = 0; i < 3; ++i) {
+        snprintf(path, sizeof(path), "%s/%s", sd_card_path, directories[i]);
+        if (mkdir(path, 0700) != 0) return false;
+    }
+
+    get_configuration_path(configuration_path);
+    return write_configuration();
+}
+
+static void remove_sd_card() {
+    remove(configuration_path);
+
+    char path[256];
+    const char* directories[] = { "wiiu/apps/RWUG", "wiiu/apps", "wiiu" };
+    for (uint8_t i = 0; i < 3; ++i) {
+        snprintf(path, sizeof(path), "%s/%s", sd_card_path, directories[i]);
+        rmdir(path);
+    }
+    rmdir(sd_card_path);
+}
+
+// Sets up the client like main.c does after the menu.
+static bool start_client() {
+    config = load_configuration(configuration_path);
+    if (!config.loaded || configuration_size <= 4096 || config.dsu_port_count != 2) return false;
+
+    set_address(&rwug_server_address, config.ip_address, RWUG_PORT);
+    set_address(&telemetry_address, config.telemetry_address, config.telemetry_port);
+
+    configure_prediction(config.prediction_latency, config.prediction_alpha, config.prediction_beta);
+    configure_remap(&config.remap);
+    configure_input(config.average_motion);
+
+    init_dsu();
+    if (!open_sockets()) return false;
+
+    configure_rwug(config.history_length, config.prediction_latency != 0, config.edges, config.microphone, false, 1000000 / config.send_interval);
+    start_rwug_handshake();
+    configure_power(config.idle_timeout, config.screen_timeout, get_microseconds());
+
+    memset(&state, 0, sizeof(state));
+    state.socket = &client_socket;
+    state.enable_rwug = true;
+    state.dsu_servers = dsu_servers;
+    state.dsu_server_count = 2;
+    state.enable_telemetry = true;
+    state.rwug_server_address = &rwug_server_address;
+    state.rwug_server_address_size = sizeof(rwug_server_address);
+    state.telemetry_address = &telemetry_address;
+    state.telemetry_address_size = sizeof(telemetry_address);
+    state.power = POWER_ACTIVE;
+    state.update_rate = config.send_interval;
+    OSInitMutex(&state.mutex);
+
+    // The saved server answers the discovery, so the client keeps it.
+    rwug_servers[0].ready_time = now + RWUG_STARTUP_TIME;
+    start_discovery();
+
+    return true;
+}
+
+int main(int argc, char** argv) {
+    uint32_t days = argc > 1 ? strtoul(argv[1], NULL, 10) : DEFAULT_DAYS;
+
+    if (!create_sd_card() || !start_client()) {
+        printf("could not start the client\n");
+        close_sockets();
+        remove_sd_card();
+        return 1;
+    }
+
+    dsu_servers[0].outgoing_packet_count = dsu_servers[1].outgoing_packet_count = (uint32_t) -COUNTER_HEADROOM;
+    dsu_servers[0].statistics.packets_sent = (uint32_t) -COUNTER_HEADROOM;
+    telemetry.samples_read = telemetry.rwug_packets_sent = (uint32_t) -COUNTER_HEADROOM;
+    const uint32_t first_errors = get_send_errors();
+    const uint32_t first_sent = get_packets_sent();
+
+    // Allocates the buffer of stdout before the heap is measured.
+    printf("soaking for %lu simulated days\n", (unsigned long) days);
+
+    OSTime next_update = now;
+    while (now < days * DAY) {
+        next_update = update(next_update);
+        check_screen();
+
+        if (passed(HOUR, 0)) {
+            check_hour();
+            check_heap();
+        }
+
+        if (passed(DAY, 0)) {
+            check_send_errors(first_errors, first_sent);
+            printf("day %llu: %llu dsu packets, %llu rwug packets, %lu handshakes, %lu server moves, %lu telemetry lines (%lu idle), %lu hitch dumps, heap %+ld bytes, %lu send errors\n",
+                (unsigned long long) (now / DAY), (unsigned long long) statistics.dsu_packets, (unsigned long long) statistics.rwug_packets,
+                (unsigned long) statistics.handshakes, (unsigned long) statistics.server_moves, (unsigned long) statistics.telemetry_lines,
+                (unsigned long) statistics.idle_lines, (unsigned long) statistics.hitch_dumps, heap_growth,
+                (unsigned long) (get_send_errors() - first_errors));
+            fflush(stdout);
+        }
+    }
+
+    if (telemetry.rumble_commands != statistics.rumble_commands) {
+        fail("rumble: %lu of %lu commands handled", (unsigned long) telemetry.rumble_commands, (unsigned long) statistics.rumble_commands);
+    }
+    if (statistics.hitch_dumps != statistics.disturbances) {
+        fail("flight recorder: %lu dumps for %lu hitches", (unsigned long) statistics.hitch_dumps, (unsigned long) statistics.disturbances);
+    }
+    if (statistics.combo_dumps != days) {
+        fail("flight recorder: %lu dumps requested with the button combination in %lu days", (unsigned long) statistics.combo_dumps, (unsigned long) days);
+    }
+    check_send_errors(first_errors, first_sent);
+
+    restore_power();
+    close_sockets();
+    remove_sd_card();
+
+    if (failures > 0) {
+        printf("soak failed with %lu violations\n", (unsigned long) failures);
+        return 1;
+    }
+
+    printf("soak passed\n");
+    return 0;
+}
@@ -0,0 +1,186 @@
+#!/usr/bin/env python3
+# Receives the telemetry datagrams of the RWUG client and prints them as CSV
+# or serves them as Prometheus text on http://<host>:<http-port>/metrics.
+# For long runs, budgets for heap loss, loop period drift and send errors end the collector with an error once exceeded.
+#
+# Datagram format: "rwug key=value key=value ...\n", one datagram per second.
+
+import argparse
+import csv
+import http.server
+import re
+import socket
+import statistics
+import sys
+import threading
+import time
+
+# Fields that are totals since startup. All other fields are gauges.
+COUNTERS = {"uptime", "samples", "rwug_sent", "dsu_sent", "send_errors", "rumble", "audio_sent"}
+
+# Counters of every DSU server, e.g. dsu26760_sent.
+DSU_SERVER_COUNTER = re.compile(r"dsu\d+_(requests|sent|errors)")
+
+# Counters are 32 bits wide on the client and wrap around.
+COUNTER_RANGE = 1 << 32
+
+# Amount of datagrams (seconds) the loop period baseline and every later window of the drift budget cover.
+DRIFT_WINDOW = 60
+
+
+def is_counter(key):
+    return key in COUNTERS or DSU_SERVER_COUNTER.fullmatch(key) is not None
+
+
+class Budgets:
+    """Checks the datagrams of a client against the budgets of a long run. A restart of the client starts over."""
+
+    def __init__(self, args):
+        self.max_heap_loss = args.max_heap_loss
+        self.max_loop_drift = args.max_loop_drift
+        self.max_error_rate = args.max_error_rate
+        self.first = None
+        self.previous = None
+        self.totals = {}
+        self.loop_periods = []
+        self.loop_baseline = None
+
+    # Returns a description of the first violated budget, or None.
+    def check(self, values):
+        previous = self.previous
+        self.previous = values
+
+        if previous is None or values.get("uptime", 0) < previous.get("uptime", 0):
+            self.first = values
+            self.totals = {}
+            self.loop_periods = []
+            self.loop_baseline = None
+            return None
+
+        if values.get("uptime", 0) > previous.get("uptime", 0) + 2:
+            print(f"telemetry gap of {values['uptime'] - previous['uptime']} s", file=sys.stderr)
+
+        # Counters only grow, so a decrease that isn't a plausible wrap around means they were corrupted.
+        for key, value in values.items():
+            if not is_counter(key) or key not in previous:
+                continue
+
+            increase = (value - previous[key]) % COUNTER_RANGE
+            if increase > COUNTER_RANGE // 2:
+                return f"{key} went back from {previous[key]} to {value}"
+            self.totals[key] = self.totals.get(key, 0) + increase
+
+        if self.max_heap_loss is not None and "heap_free" in values and "heap_free" in self.first:
+            loss = self.first["heap_free"] - values["heap_free"]
+            if loss > self.max_heap_loss:
+                return f"free heap shrank by {loss} bytes"
+
+        # Idle intervals run at the idle update rate, so they would look like a slow loop.
+        if self.max_loop_drift is not None and "loop_p99" in values and not values.get("idle", 0):
+            self.loop_periods.append(values["loop_p99"])
+            if len(self.loop_periods) == DRIFT_WINDOW:
+                median = statistics.median_low(self.loop_periods)
+                self.loop_periods = []
+
+                if self.loop_baseline is None:
+                    self.loop_baseline = median
+                elif median - self.loop_baseline > self.max_loop_drift:
+                    return f"loop_p99 drifted from {self.loop_baseline} us to {median} us"
+
+        sent = self.totals.get("rwug_sent", 0) + self.totals.get("dsu_sent", 0)
+        errors = self.totals.get("send_errors", 0)
+        if self.max_error_rate is not None and sent + errors > 0 and errors / (sent + errors) > self.max_error_rate:
+            return f"{errors} of {sent + errors} sends failed"
+
+        return None
+
+
+def parse(datagram):
+    fields = datagram.decode("ascii", errors="replace").split()
+    if not fields or fields[0] != "rwug":
+        return None
+
+    values = {}
+    for field in fields[1:]:
+        key, _, value = field.partition("=")
+        if value.isdigit():
+            values[key] = int(value)
+
+    return values
+
+
+def serve_prometheus(port, latest):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        def do_GET(self):
+            if self.path != "/metrics":
+                self.send_error(404)
+                return
+
+            lines = []
+            for client, values in sorted(latest.items()):
+                for key, value in values.items():
+                    metric_type = "counter" if is_counter(key) else "gauge"
+                    lines.append(f"# TYPE rwug_{key} {metric_type}")
+                    lines.append(f'rwug_{key}{{client="{client}"}} {value}')
+
+            body = ("\n".join(lines) + "\n").encode("ascii")
+            self.send_response(200)
+            self.send_header("Content-Type", "text/plain; version=0.0.4")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            self.wfile.write(body)
+
+        def log_message(self, *args):
+            pass
+
+    server = http.server.ThreadingHTTPServer(("", port), Handler)
+    threading.Thread(target=server.serve_forever, daemon=True).start()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Collects telemetry of the RWUG client.")
+    parser.add_argument("--port", type=int, default=4244, help="UDP port the client publishes to (default: 4244)")
+    parser.add_argument("--format", choices=("csv", "prometheus"), default="csv")
+    parser.add_argument("--http-port", type=int, default=9424, help="port of the Prometheus endpoint (default: 9424)")
+    parser.add_argument("--max-heap-loss", type=int, help="fail if the free heap shrinks by more bytes than this")
+    parser.add_argument("--max-loop-drift", type=int, help=f"fail if the median loop_p99 of {DRIFT_WINDOW} s rises by more microseconds than this")
+    parser.add_argument("--max-error-rate", type=float, help="fail if a larger fraction of the sends fails, e.g. 0.001")
+    args = parser.parse_args()
+
+    udp_socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    udp_socket.bind(("", args.port))
+
+    latest = {}
+    budgets = {}
+    writer = None
+
+    if args.format == "prometheus":
+        serve_prometheus(args.http_port, latest)
+
+    while True:
+        datagram, (client, _) = udp_socket.recvfrom(512)
+        values = parse(datagram)
+        if values is None:
+            continue
+
+        violation = budgets.setdefault(client, Budgets(args)).check(values)
+        if violation is not None:
+            sys.exit(f"{client}: {violation}")
+
+        if args.format == "prometheus":
+            latest[client] = values
+            continue
+
+        if writer is None:
+            writer = csv.DictWriter(sys.stdout, fieldnames=["time", "client"] + list(values.keys()), extrasaction="ignore")
+            writer.writeheader()
+
+        writer.writerow({"time": f"{time.time():.3f}", "client": client, **values})
+        sys.stdout.flush()
+
+
+if __name__ == "__main__":
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass